@@ -7,6 +7,7 @@
 #include "Vector.hpp"
 #include "Light.hpp"
 #include "global.hpp"
+#include "Sampler.hpp"
 
 class AreaLight : public Light
 {
@@ -19,10 +20,10 @@ public:
         length = 100;
     }
 
-    Vector3f SamplePoint() const
+    Vector3f SamplePoint(Sampler &sampler) const
     {
-        auto random_u = get_random_float();
-        auto random_v = get_random_float();
+        auto random_u = sampler.get1D();
+        auto random_v = sampler.get1D();
         return position + random_u * u + random_v * v;
     }
 
@@ -1,153 +1,938 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include "BVH.hpp"
+#include "Sphere.hpp"
+#include "Instance.hpp"
+#include "ThreadPool.hpp"
+#include "Stats.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
-                   SplitMethod splitMethod)
+                   SplitMethod splitMethod, int width)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
-      primitives(std::move(p))
+      primitives(std::move(p)), width(width)
 {
-    time_t start, stop;
-    time(&start);
     if (primitives.empty())
         return;
 
-    root = recursiveBuild(primitives);
+    // 球体和网格在叶节点里按类型直接求交，其余物体走虚函数
+    std::vector<Bounds3> primBounds(primitives.size());
+    std::vector<uint8_t> primTypes(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        primBounds[i] = primitives[i]->getBounds();
+        PrimType type = PrimType::Object;
+        if (dynamic_cast<Sphere*>(primitives[i]))
+            type = PrimType::Sphere;
+        else if (dynamic_cast<Instance*>(primitives[i]))
+            type = PrimType::Instance;
+        else if (primitives[i]->getAccel())
+            type = PrimType::Mesh;
+        primTypes[i] = (uint8_t)type;
+    }
+    std::vector<uint32_t> order;
+    build(primBounds, primTypes, order);
+
+    // 叶节点引用的是 order 中的连续区间，按这个顺序重排图元，同时填充各类型数组
+    std::vector<Object*> orderedPrims(primitives.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        Object* prim = primitives[order[i]];
+        orderedPrims[i] = prim;
+        if (primTypes[order[i]] == (uint8_t)PrimType::Sphere) {
+            auto sphere = static_cast<Sphere*>(prim);
+            spheres.push_back({sphere->center, sphere->radius2, sphere, sphere->m});
+        }
+        else if (primTypes[order[i]] == (uint8_t)PrimType::Mesh) {
+            meshes.push_back(prim->getAccel());
+        }
+        else if (primTypes[order[i]] == (uint8_t)PrimType::Instance) {
+            instances.push_back(static_cast<Instance*>(prim));
+        }
+    }
+    primitives.swap(orderedPrims);
+
+    areaCdf.reserve(primitives.size());
+    for (auto prim : primitives) {
+        totalArea += prim->getArea();
+        areaCdf.push_back(totalArea);
+    }
+}
+
+BVHAccel::BVHAccel(TriangleMesh* mesh, int maxPrimsInNode, SplitMethod splitMethod, int width)
+    : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod), mesh(mesh), width(width)
+{
+    if (mesh->size() == 0)
+        return;
+
+    std::vector<Bounds3> primBounds(mesh->size());
+    for (size_t i = 0; i < mesh->size(); ++i)
+        primBounds[i] = mesh->getBounds(i);
+    std::vector<uint8_t> primTypes(mesh->size(), (uint8_t)PrimType::Triangle);
+    std::vector<uint32_t> order;
+    build(primBounds, primTypes, order);
+    mesh->reorder(order);
+
+    areaCdf.reserve(mesh->size());
+    for (size_t i = 0; i < mesh->size(); ++i) {
+        totalArea += mesh->getArea(i);
+        areaCdf.push_back(totalArea);
+    }
+}
+
+BVHAccel::BVHAccel(TriangleMesh* mesh, Buffer<LinearBVHNode> prebuiltNodes, Buffer<float> prebuiltCdf, int width)
+    : maxPrimsInNode(4), splitMethod(SplitMethod::SAH), mesh(mesh), nodes(std::move(prebuiltNodes)), width(width),
+      areaCdf(std::move(prebuiltCdf))
+{
+    if (nodes.empty())
+        return;
+
+    // 宽 BVH 不在快照里，按需从二叉树合并
+    if (width == 4)
+        collapseBVH<4>(wide4, 0);
+    else if (width == 8)
+        collapseBVH<8>(wide8, 0);
 
-    time(&stop);
-    double diff = difftime(stop, start);
-    int hrs = (int)diff / 3600;
-    int mins = ((int)diff / 60) - (hrs * 60);
-    int secs = (int)diff - (hrs * 3600) - (mins * 60);
+    if (!areaCdf.empty()) {
+        totalArea = areaCdf.back();
+        return;
+    }
+    areaCdf.reserve(mesh->size());
+    for (size_t i = 0; i < mesh->size(); ++i) {
+        totalArea += mesh->getArea(i);
+        areaCdf.push_back(totalArea);
+    }
+}
+
+void BVHAccel::build(const std::vector<Bounds3> &primBounds, const std::vector<uint8_t> &primTypes,
+                     std::vector<uint32_t> &order)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // 只对图元下标和包围盒排序，不移动图元本身
+    std::vector<BVHPrimitiveInfo> primitiveInfo(primBounds.size());
+    for (size_t i = 0; i < primBounds.size(); ++i)
+        primitiveInfo[i] = BVHPrimitiveInfo(i, primBounds[i], primTypes[i]);
+
+    // 图元足够多时，先串行划分顶部几层，再把得到的子树交给线程池并行构建
+    std::atomic<int> totalNodes{0};
+    std::vector<BVHBuildTask> tasks;
+    ThreadPool& pool = ThreadPool::global();
+    bool parallel = primitiveInfo.size() >= 4096 && pool.size() > 1 &&
+                    ThreadPool::currentWorker() < 0;
+    int taskDepth = 0;
+    while (parallel && (1 << taskDepth) < 4 * pool.size())
+        taskDepth++;
+
+    BVHBuildNode* root = recursiveBuild(primitiveInfo, 0, primitiveInfo.size(), totalNodes,
+                                        0, parallel ? &tasks : nullptr, taskDepth);
+    pool.parallelFor(tasks.size(), [&](int i, int) {
+        BVHBuildTask& task = tasks[i];
+        BVHBuildNode* subtree = recursiveBuild(primitiveInfo, task.start, task.end, totalNodes, taskDepth);
+        *task.node = *subtree;
+        delete subtree;
+    });
+
+    order.resize(primitiveInfo.size());
+    for (size_t i = 0; i < primitiveInfo.size(); ++i)
+        order[i] = primitiveInfo[i].primitiveNumber;
+    auto built = std::chrono::steady_clock::now();
+
+    // 压平成线性数组，遍历时不再追指针
+    nodes.resize(totalNodes);
+    int offset = 0;
+    flattenBVHTree(root, &offset);
+    assert(offset == totalNodes);
+    deleteBuildTree(root);
 
-    printf(
-        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
-        hrs, mins, secs);
+    // 叶节点偏移换成所属类型数组中的下标 (Object 类型仍是 primitives 中的下标)
+    std::vector<int> typedOffset(order.size());
+    int typeCount[(int)PrimType::Count] = {};
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint8_t type = primTypes[order[i]];
+        typedOffset[i] = type == (uint8_t)PrimType::Object ? (int)i : typeCount[type]++;
+    }
+    for (auto &node : nodes)
+        if (node.nPrimitives > 0)
+            node.primitivesOffset = typedOffset[node.primitivesOffset];
+    auto flattened = std::chrono::steady_clock::now();
+
+    if (width == 4)
+        collapseBVH<4>(wide4, 0);
+    else if (width == 8)
+        collapseBVH<8>(wide8, 0);
+    auto stop = std::chrono::steady_clock::now();
+
+    // 分阶段计时：划分建树、压平、合并成宽 BVH
+    auto ms = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    printf("\rBVH Generation complete: %zu primitives, %zu nodes\n"
+           "Time Taken: %.3f ms (build %.3f ms, flatten %.3f ms, collapse %.3f ms)\n\n",
+           primBounds.size(), nodes.size(), ms(start, stop), ms(start, built), ms(built, flattened),
+           ms(flattened, stop));
+}
+
+BVHAccel::~BVHAccel() {}
+
+Bounds3 BVHAccel::WorldBound() const
+{
+    return nodes.empty() ? Bounds3() : nodes[0].bounds;
 }
 
-BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
+BVHBuildNode* BVHAccel::recursiveBuild(std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end,
+                                       std::atomic<int> &totalNodes, int depth,
+                                       std::vector<BVHBuildTask>* tasks, int taskDepth)
 {
     BVHBuildNode* node = new BVHBuildNode();
 
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
-    for (int i = 0; i < objects.size(); ++i)
-        bounds = Union(bounds, objects[i]->getBounds());
-    if (objects.size() == 1) {
-        // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
-        node->object = objects[0];
-        node->left = nullptr;
-        node->right = nullptr;
-        node->area = objects[0]->getArea();
+    bool mixedTypes = false;
+    for (int i = start; i < end; ++i) {
+        bounds = Union(bounds, primitiveInfo[i].bounds);
+        mixedTypes |= primitiveInfo[i].type != primitiveInfo[start].type;
+    }
+    node->bounds = bounds;
+
+    int nPrimitives = end - start;
+    if (tasks && depth == taskDepth && nPrimitives > 1) {
+        // 占位节点，由并行任务填充，节点数在任务里统计
+        tasks->push_back({node, start, end});
         return node;
     }
-    else if (objects.size() == 2) {
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
+    totalNodes++;
 
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
+    // Create leaf _BVHBuildNode_，叶节点引用 primitiveInfo 中的连续区间
+    auto makeLeaf = [&]() {
+        if (mixedTypes) {
+            // 叶节点只能有一种图元类型，混在一起时按类型再分一层
+            uint8_t type = primitiveInfo[start].type;
+            BVHPrimitiveInfo* mid = std::partition(&primitiveInfo[start], &primitiveInfo[end - 1] + 1,
+                [type](const BVHPrimitiveInfo &pi) { return pi.type == type; });
+            int split = mid - &primitiveInfo[0];
+            node->left = recursiveBuild(primitiveInfo, start, split, totalNodes, depth + 1, tasks, taskDepth);
+            node->right = recursiveBuild(primitiveInfo, split, end, totalNodes, depth + 1, tasks, taskDepth);
+            return node;
+        }
+        node->firstPrimOffset = start;
+        node->nPrimitives = nPrimitives;
+        node->primType = primitiveInfo[start].type;
         return node;
+    };
+    if (nPrimitives == 1)
+        return makeLeaf();
+
+    Bounds3 centroidBounds;
+    for (int i = start; i < end; ++i)
+        centroidBounds = Union(centroidBounds, primitiveInfo[i].centroid);
+    int dim = centroidBounds.maxExtent();
+    node->splitAxis = dim;
+
+    // 叶节点深度不能超过遍历栈的大小。对半分下去还需要 ceil(log2(n)) 层，剩下的层数刚好够时
+    // 改为按中位数对半分，只有单一类型的图元才直接做叶节点（混合类型会再按类型多分几层）
+    int levels = 0;
+    while ((1u << levels) < (unsigned)nPrimitives)
+        ++levels;
+    bool tooDeep = depth + levels >= maxTreeDepth;
+    if (tooDeep && !mixedTypes && nPrimitives <= maxPrimsInNode)
+        return makeLeaf();
+
+    // 质心重合无法划分，或者图元已经足够少 (SAH 由代价决定)
+    bool degenerate = !(centroidBounds.pMax[dim] > centroidBounds.pMin[dim]);
+    if (!tooDeep && nPrimitives <= maxPrimsInNode && (degenerate || splitMethod != SplitMethod::SAH))
+        return makeLeaf();
+
+    BVHPrimitiveInfo* first = &primitiveInfo[start];
+    BVHPrimitiveInfo* last = &primitiveInfo[end - 1] + 1;
+    auto byCentroid = [dim](const BVHPrimitiveInfo &a, const BVHPrimitiveInfo &b) {
+        return a.centroid[dim] < b.centroid[dim];
+    };
+
+    int mid = (start + end) / 2;
+    if (tooDeep) {
+        std::nth_element(first, &primitiveInfo[mid], last, byCentroid);
     }
-    else {
-        Bounds3 centroidBounds;
-        for (int i = 0; i < objects.size(); ++i)
-            centroidBounds =
-                Union(centroidBounds, objects[i]->getBounds().Centroid());
-        int dim = centroidBounds.maxExtent();
-        switch (dim) {
-        case 0:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().x <
-                       f2->getBounds().Centroid().x;
-            });
+    else if (!degenerate) {
+        switch (splitMethod) {
+        case SplitMethod::MIDDLE: {
+            // 按质心包围盒的中点一分为二
+            float pmid = (centroidBounds.pMin[dim] + centroidBounds.pMax[dim]) / 2;
+            BVHPrimitiveInfo* midPtr = std::partition(first, last,
+                [dim, pmid](const BVHPrimitiveInfo &pi) { return pi.centroid[dim] < pmid; });
+            mid = midPtr - &primitiveInfo[0];
+            if (mid != start && mid != end)
+                break;
+            // 全部落在同一侧时退化为中位数划分
+            mid = (start + end) / 2;
+            std::nth_element(first, &primitiveInfo[mid], last, byCentroid);
             break;
-        case 1:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().y <
-                       f2->getBounds().Centroid().y;
-            });
+        }
+        case SplitMethod::SAH:
+            mid = partitionSAH(primitiveInfo, start, end, dim, bounds, centroidBounds);
+            if (mid < 0)
+                return makeLeaf();
             break;
-        case 2:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().z <
-                       f2->getBounds().Centroid().z;
-            });
+        case SplitMethod::NAIVE:
+        default:
+            std::nth_element(first, &primitiveInfo[mid], last, byCentroid);
             break;
         }
+    }
 
-        auto beginning = objects.begin();
-        auto middling = objects.begin() + (objects.size() / 2);
-        auto ending = objects.end();
+    node->left = recursiveBuild(primitiveInfo, start, mid, totalNodes, depth + 1, tasks, taskDepth);
+    node->right = recursiveBuild(primitiveInfo, mid, end, totalNodes, depth + 1, tasks, taskDepth);
+    return node;
+}
 
-        auto leftshapes = std::vector<Object*>(beginning, middling);
-        auto rightshapes = std::vector<Object*>(middling, ending);
+int BVHAccel::partitionSAH(std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end, int dim,
+                           const Bounds3 &bounds, const Bounds3 &centroidBounds)
+{
+    // 把质心沿 dim 轴分到若干个桶里，只在桶边界上评估划分代价
+    constexpr int nBuckets = 12;
+    struct BucketInfo {
+        int count = 0;
+        Bounds3 bounds;
+    };
+    BucketInfo buckets[nBuckets];
 
-        assert(objects.size() == (leftshapes.size() + rightshapes.size()));
+    auto bucketOf = [&](const BVHPrimitiveInfo &pi) {
+        int b = nBuckets * centroidBounds.Offset(pi.centroid)[dim];
+        return std::min(b, nBuckets - 1);
+    };
+    for (int i = start; i < end; ++i) {
+        int b = bucketOf(primitiveInfo[i]);
+        buckets[b].count++;
+        buckets[b].bounds = Union(buckets[b].bounds, primitiveInfo[i].bounds);
+    }
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
+    // 从左右两边扫描，得到每个划分位置两侧的包围盒和图元数
+    float leftArea[nBuckets - 1], rightArea[nBuckets - 1];
+    int leftCount[nBuckets - 1], rightCount[nBuckets - 1];
+    Bounds3 b;
+    int count = 0;
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        b = Union(b, buckets[i].bounds);
+        count += buckets[i].count;
+        leftArea[i] = count ? b.SurfaceArea() : 0;
+        leftCount[i] = count;
+    }
+    b = Bounds3();
+    count = 0;
+    for (int i = nBuckets - 1; i > 0; --i) {
+        b = Union(b, buckets[i].bounds);
+        count += buckets[i].count;
+        rightArea[i - 1] = count ? b.SurfaceArea() : 0;
+        rightCount[i - 1] = count;
+    }
 
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
+    // 代价 = 遍历代价 + 两侧 (图元数 * 表面积) / 父节点表面积 * 求交代价
+    // 叶节点按图元类型直接调用内联的求交（三角形读 SoA 数组），不再经过虚函数，
+    // 一次图元求交和一次包围盒测试的代价相近，两者都按 1 计
+    constexpr float traversalCost = 1.f, intersectCost = 1.f;
+    float invArea = 1 / std::max(bounds.SurfaceArea(), 1e-12);
+    float minCost = std::numeric_limits<float>::infinity();
+    int minCostSplitBucket = -1;
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        if (leftCount[i] == 0 || rightCount[i] == 0)
+            continue;
+        float cost = traversalCost +
+                     intersectCost * (leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i]) * invArea;
+        if (cost < minCost) {
+            minCost = cost;
+            minCostSplitBucket = i;
+        }
     }
 
-    return node;
+    // 不划分的代价就是逐个测试所有图元；放得下又不比划分差时直接做叶节点
+    int nPrimitives = end - start;
+    float leafCost = intersectCost * nPrimitives;
+    if (nPrimitives <= maxPrimsInNode && (minCostSplitBucket < 0 || leafCost <= minCost))
+        return -1;
+    if (minCostSplitBucket < 0)
+        return (start + end) / 2;
+
+    BVHPrimitiveInfo* pmid = std::partition(&primitiveInfo[start], &primitiveInfo[end - 1] + 1,
+        [&](const BVHPrimitiveInfo &pi) { return bucketOf(pi) <= minCostSplitBucket; });
+    return pmid - &primitiveInfo[0];
+}
+
+int BVHAccel::flattenBVHTree(BVHBuildNode* node, int* offset)
+{
+    LinearBVHNode* linearNode = &nodes[*offset];
+    linearNode->bounds = node->bounds;
+    int myOffset = (*offset)++;
+    if (node->nPrimitives > 0) {
+        linearNode->primitivesOffset = node->firstPrimOffset;
+        linearNode->nPrimitives = node->nPrimitives;
+        linearNode->primType = node->primType;
+    }
+    else {
+        // Create interior flattened BVH node
+        linearNode->axis = node->splitAxis;
+        linearNode->nPrimitives = 0;
+        flattenBVHTree(node->left, offset);
+        linearNode->secondChildOffset = flattenBVHTree(node->right, offset);
+    }
+    return myOffset;
+}
+
+void BVHAccel::deleteBuildTree(BVHBuildNode* node)
+{
+    if (!node)
+        return;
+    deleteBuildTree(node->left);
+    deleteBuildTree(node->right);
+    delete node;
+}
+
+// 球体叶节点，与 Sphere::getIntersection 相同
+static inline void intersectSphere(const SpherePrim &sphere, Ray &r, Intersection &isect)
+{
+    float t;
+    if (!Sphere::hit(sphere.center, sphere.radius2, r, t) || t >= isect.distance)
+        return;
+    isect.happened = true;
+    isect.coords = Vector3f(r.origin + r.direction * t);
+    isect.normal = normalize(Vector3f(isect.coords - sphere.center));
+    isect.m = sphere.m;
+    isect.obj = sphere.obj;
+    isect.primIndex = 0;
+    isect.distance = t;
+    r.t_max = t;
+}
+
+inline void BVHAccel::intersectLeaf(uint8_t type, int offset, int count, Ray &r, Intersection &isect) const
+{
+    switch (PrimType(type)) {
+    case PrimType::Triangle:
+        mesh->intersect(offset, count, r, isect);
+        break;
+    case PrimType::Sphere:
+        for (int i = offset; i < offset + count; ++i)
+            intersectSphere(spheres[i], r, isect);
+        break;
+    case PrimType::Mesh:
+        for (int i = offset; i < offset + count; ++i)
+            meshes[i]->Intersect(r, isect);
+        break;
+    case PrimType::Instance:
+        for (int i = offset; i < offset + count; ++i)
+            instances[i]->intersect(r, isect);
+        break;
+    default:
+        for (int i = offset; i < offset + count; ++i) {
+            Intersection hit = primitives[i]->getIntersection(r);
+            if (hit.happened && hit.distance < isect.distance) {
+                isect = hit;
+                r.t_max = hit.distance;
+            }
+        }
+        break;
+    }
+}
+
+inline bool BVHAccel::occludedLeaf(uint8_t type, int offset, int count, const Ray &r) const
+{
+    float t;
+    switch (PrimType(type)) {
+    case PrimType::Triangle:
+        return mesh->occluded(offset, count, r);
+    case PrimType::Sphere:
+        for (int i = offset; i < offset + count; ++i)
+            if (Sphere::hit(spheres[i].center, spheres[i].radius2, r, t))
+                return true;
+        return false;
+    case PrimType::Mesh:
+        for (int i = offset; i < offset + count; ++i)
+            if (meshes[i]->IntersectP(r))
+                return true;
+        return false;
+    case PrimType::Instance:
+        for (int i = offset; i < offset + count; ++i)
+            if (instances[i]->occluded(r))
+                return true;
+        return false;
+    default:
+        for (int i = offset; i < offset + count; ++i)
+            if (primitives[i]->intersect(r))
+                return true;
+        return false;
+    }
+}
+
+inline void BVHAccel::intersectPacketLeaf(uint8_t type, int offset, int count, RayPacket &packet,
+                                          uint32_t mask, Intersection *hits) const
+{
+    switch (PrimType(type)) {
+    case PrimType::Triangle:
+        mesh->intersectPacket(offset, count, packet, mask, hits);
+        break;
+    case PrimType::Mesh:
+        for (int i = offset; i < offset + count; ++i)
+            meshes[i]->IntersectPacket(packet, mask, hits);
+        break;
+    case PrimType::Sphere:
+    case PrimType::Instance:
+        // 实例要把每条光线变换到各自的物体空间，逐条处理
+        for (int lane = 0; lane < RayPacket::Size; ++lane) {
+            if (!(mask & (1u << lane)))
+                continue;
+            Ray r = packet.ray(lane);
+            intersectLeaf(type, offset, count, r, hits[lane]);
+            packet.tMax[lane] = r.t_max;
+        }
+        break;
+    default:
+        for (int i = offset; i < offset + count; ++i)
+            primitives[i]->intersectPacket(packet, mask, hits);
+        break;
+    }
+}
+
+template <int N>
+int BVHAccel::collapseBVH(std::vector<WideBVHNode<N>> &wide, int nodeIndex) const
+{
+    // 反复把表面积最大的内部子节点换成它的两个孩子，直到凑满 N 个
+    int slots[N];
+    int n = 0;
+    if (nodes[nodeIndex].nPrimitives > 0) {
+        slots[n++] = nodeIndex;
+    }
+    else {
+        slots[n++] = nodeIndex + 1;
+        slots[n++] = nodes[nodeIndex].secondChildOffset;
+    }
+    while (n < N) {
+        int best = -1;
+        double bestArea = -1;
+        for (int i = 0; i < n; ++i) {
+            const LinearBVHNode &c = nodes[slots[i]];
+            if (c.nPrimitives == 0 && c.bounds.SurfaceArea() > bestArea) {
+                bestArea = c.bounds.SurfaceArea();
+                best = i;
+            }
+        }
+        if (best < 0)
+            break;
+        int expanded = slots[best];
+        slots[best] = expanded + 1;
+        slots[n++] = nodes[expanded].secondChildOffset;
+    }
+
+    int index = wide.size();
+    wide.emplace_back();
+    for (int i = 0; i < N; ++i) {
+        // 空槽的包围盒取反，任何光线都不会命中
+        for (int a = 0; a < 3; ++a) {
+            wide[index].bounds[0][a][i] = std::numeric_limits<float>::infinity();
+            wide[index].bounds[1][a][i] = -std::numeric_limits<float>::infinity();
+        }
+        wide[index].child[i] = -1;
+        wide[index].count[i] = 0;
+        wide[index].type[i] = 0;
+    }
+    for (int i = 0; i < n; ++i) {
+        const LinearBVHNode &c = nodes[slots[i]];
+        int child, count, type = 0;
+        if (c.nPrimitives > 0) {
+            type = c.primType;
+            child = c.primitivesOffset;
+            count = c.nPrimitives;
+        }
+        else {
+            child = collapseBVH(wide, slots[i]);
+            count = 0;
+        }
+        // 递归可能让 wide 重新分配，这里重新取引用
+        WideBVHNode<N> &w = wide[index];
+        for (int a = 0; a < 3; ++a) {
+            w.bounds[0][a][i] = c.bounds.pMin[a];
+            w.bounds[1][a][i] = c.bounds.pMax[a];
+        }
+        w.child[i] = child;
+        w.count[i] = count;
+        w.type[i] = type;
+    }
+    return index;
+}
+
+// 一次测试 N 个子节点的包围盒，返回命中掩码，tEnter 写入每个子节点的进入距离。
+// near/far 按方向符号选取，NaN 的比较结果被丢弃 (与 Bounds3::IntersectP 一致)
+template <int N>
+static inline int intersectChildren(const WideBVHNode<N> &node, const Vector3f &org, const Vector3f &invDir,
+                                    const std::array<int, 3> &dirIsNeg, float tMax, float* tEnter)
+{
+    int mask = 0;
+    for (int i = 0; i < N; ++i) {
+        float t0 = 0, t1 = tMax;
+        for (int a = 0; a < 3; ++a) {
+            float tNear = (node.bounds[dirIsNeg[a]][a][i] - org[a]) * invDir[a];
+            float tFar = (node.bounds[1 - dirIsNeg[a]][a][i] - org[a]) * invDir[a];
+            if (tNear > t0) t0 = tNear;
+            if (tFar < t1) t1 = tFar;
+        }
+        tEnter[i] = t0;
+        if (t0 <= t1)
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+#if defined(__SSE2__)
+// maxps/minps 遇到 NaN 时返回第二个操作数，正好保留之前的 t0/t1
+template <>
+inline int intersectChildren<4>(const WideBVHNode<4> &node, const Vector3f &org, const Vector3f &invDir,
+                                const std::array<int, 3> &dirIsNeg, float tMax, float* tEnter)
+{
+    __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        __m128 o = _mm_set1_ps(org[a]), inv = _mm_set1_ps(invDir[a]);
+        __m128 tNear = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[dirIsNeg[a]][a]), o), inv);
+        __m128 tFar = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - dirIsNeg[a]][a]), o), inv);
+        t0 = _mm_max_ps(tNear, t0);
+        t1 = _mm_min_ps(tFar, t1);
+    }
+    _mm_storeu_ps(tEnter, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+#if defined(__AVX__)
+template <>
+inline int intersectChildren<8>(const WideBVHNode<8> &node, const Vector3f &org, const Vector3f &invDir,
+                                const std::array<int, 3> &dirIsNeg, float tMax, float* tEnter)
+{
+    __m256 t0 = _mm256_setzero_ps(), t1 = _mm256_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        __m256 o = _mm256_set1_ps(org[a]), inv = _mm256_set1_ps(invDir[a]);
+        __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[dirIsNeg[a]][a]), o), inv);
+        __m256 tFar = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[1 - dirIsNeg[a]][a]), o), inv);
+        t0 = _mm256_max_ps(tNear, t0);
+        t1 = _mm256_min_ps(tFar, t1);
+    }
+    _mm256_storeu_ps(tEnter, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+// 宽 BVH 栈中的一项：子节点引用和它的进入距离
+struct WideStackEntry {
+    int child;
+    int count;
+    int type;
+    float tEnter;
+};
+
+template <int N>
+void BVHAccel::intersectWide(const std::vector<WideBVHNode<N>> &wide, Ray &r, Intersection &isect) const
+{
+    std::array<int, 3> dirsIsNeg{int(r.direction_inv.x < 0), int(r.direction_inv.y < 0),
+                                 int(r.direction_inv.z < 0)};
+
+    // 每下降一层最多净增 N - 1 项
+    WideStackEntry stack[maxTreeDepth * N];
+    int top = 0;
+    stack[top++] = {0, 0, 0, 0.f};
+    while (top > 0) {
+        WideStackEntry e = stack[--top];
+        // 入栈后找到了更近的交点，这个子树可以整个跳过
+        if (e.tEnter > r.t_max)
+            continue;
+
+        if (e.count > 0) {
+            intersectLeaf(e.type, e.child, e.count, r, isect);
+            continue;
+        }
+
+        const WideBVHNode<N> &node = wide[e.child];
+        STAT_ADD(nodesVisited, 1);
+        STAT_ADD(boxTests, N);
+        alignas(32) float tEnter[N];
+        int mask = intersectChildren<N>(node, r.origin, r.direction_inv, dirsIsNeg, r.t_max, tEnter);
+
+        // 命中的子节点按进入距离从远到近压栈，最近的先出栈
+        WideStackEntry hits[N];
+        int nHits = 0;
+        for (int i = 0; i < N; ++i) {
+            if (!(mask & (1 << i)) || (node.count[i] == 0 && node.child[i] < 0))
+                continue;
+            WideStackEntry h{node.child[i], node.count[i], node.type[i], tEnter[i]};
+            int j = nHits++;
+            while (j > 0 && hits[j - 1].tEnter < h.tEnter) {
+                hits[j] = hits[j - 1];
+                --j;
+            }
+            hits[j] = h;
+        }
+        for (int i = 0; i < nHits; ++i)
+            stack[top++] = hits[i];
+    }
+}
+
+template <int N>
+bool BVHAccel::intersectPWide(const std::vector<WideBVHNode<N>> &wide, const Ray &ray) const
+{
+    std::array<int, 3> dirsIsNeg{int(ray.direction_inv.x < 0), int(ray.direction_inv.y < 0),
+                                 int(ray.direction_inv.z < 0)};
+    float tMax = ray.t_max;
+
+    // 遮挡查询不需要排序，命中的子节点直接压栈
+    int stack[maxTreeDepth * N];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const WideBVHNode<N> &node = wide[stack[--top]];
+        STAT_ADD(nodesVisited, 1);
+        STAT_ADD(boxTests, N);
+        alignas(32) float tEnter[N];
+        int mask = intersectChildren<N>(node, ray.origin, ray.direction_inv, dirsIsNeg, tMax, tEnter);
+        for (int i = 0; i < N; ++i) {
+            if (!(mask & (1 << i)))
+                continue;
+            if (node.count[i] > 0) {
+                if (occludedLeaf(node.type[i], node.child[i], node.count[i], ray))
+                    return true;
+            }
+            else if (node.child[i] >= 0) {
+                stack[top++] = node.child[i];
+            }
+        }
+    }
+    return false;
 }
 
 Intersection BVHAccel::Intersect(const Ray& ray) const
 {
+    // TODO Traverse the BVH to find intersection
     Intersection isect;
-    if (!root)
+    if (nodes.empty())
         return isect;
-    isect = BVHAccel::getIntersection(root, ray);
+
+    // 找到交点后缩短光线区间 [0, t_max]，更远的子树和图元直接剔除
+    Ray r = ray;
+    Intersect(r, isect);
     return isect;
 }
 
-Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
+void BVHAccel::Intersect(Ray &r, Intersection &isect) const
 {
-    // TODO Traverse the BVH to find intersection
-    Intersection inter;
+    if (nodes.empty())
+        return;
+    if (!wide4.empty())
+        intersectWide(wide4, r, isect);
+    else if (!wide8.empty())
+        intersectWide(wide8, r, isect);
+    else
+        intersectSubtree(0, r, isect);
+}
 
-    //光线方向
-    float x = ray.direction.x;
-    float y = ray.direction.y;
-    float z = ray.direction.z;
+void BVHAccel::intersectSubtree(int rootIndex, Ray &r, Intersection &isect) const
+{
+    //光线方向的倒数，用它判断符号才能正确处理 -0
+    float x = r.direction_inv.x;
+    float y = r.direction_inv.y;
+    float z = r.direction_inv.z;
     //判断坐标是否为负
-    std::array<int, 3> dirsIsNeg{int(x > 0), int(y > 0), int(z > 0)};
+    std::array<int, 3> dirsIsNeg{int(x < 0), int(y < 0), int(z < 0)};
 
-    //判断当前节点的包围盒与光线是否相交
-    if(node->bounds.IntersectP(ray, ray.direction_inv, dirsIsNeg) == false)
-        return inter;
-    
-    if(node->left == nullptr && node->right == nullptr)
-    {
-        inter = node->object->getIntersection(ray);
-        return inter;
+    // 用显式栈代替递归，栈里保存待访问的节点下标
+    int toVisitOffset = 0, currentNodeIndex = rootIndex;
+    int nodesToVisit[maxTreeDepth];
+    while (true) {
+        const LinearBVHNode* node = &nodes[currentNodeIndex];
+        STAT_ADD(nodesVisited, 1);
+        STAT_ADD(boxTests, 1);
+        //判断当前节点的包围盒与光线是否相交
+        if (node->bounds.IntersectP(r, r.direction_inv, dirsIsNeg, r.t_max)) {
+            if (node->nPrimitives > 0) {
+                intersectLeaf(node->primType, node->primitivesOffset, node->nPrimitives, r, isect);
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else {
+                // 先访问光线方向上较近的子节点，远的压栈
+                if (dirsIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                }
+                else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        }
+        else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
     }
+}
 
-    //递归判断子节点是否存在与光线相交的情况
-    auto hit1 = getIntersection(node->left, ray);
-    auto hit2 = getIntersection(node->right, ray);
-
-    if(hit1.distance < hit2.distance)
-        return hit1;
-    return hit2;
+// 测试 mask 中的每条光线与一个包围盒是否相交，返回命中的子集
+static inline uint32_t intersectPacketBox(const Bounds3 &b, const RayPacket &packet, uint32_t mask,
+                                          const std::array<int, 3> &dirIsNeg)
+{
+    float nearX = b[dirIsNeg[0]].x, farX = b[1 - dirIsNeg[0]].x;
+    float nearY = b[dirIsNeg[1]].y, farY = b[1 - dirIsNeg[1]].y;
+    float nearZ = b[dirIsNeg[2]].z, farZ = b[1 - dirIsNeg[2]].z;
+    uint32_t hit = 0;
+#if defined(__SSE2__)
+    // 每次 4 条光线，NaN 的处理与 Bounds3::IntersectP 相同
+    for (int g = 0; g < RayPacket::Size; g += 4) {
+        if (!((mask >> g) & 0xF))
+            continue;
+        __m128 ox = _mm_load_ps(packet.ox + g), oy = _mm_load_ps(packet.oy + g), oz = _mm_load_ps(packet.oz + g);
+        __m128 ix = _mm_load_ps(packet.ix + g), iy = _mm_load_ps(packet.iy + g), iz = _mm_load_ps(packet.iz + g);
+        __m128 t0 = _mm_setzero_ps(), t1 = _mm_load_ps(packet.tMax + g);
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nearX), ox), ix), t0);
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nearY), oy), iy), t0);
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(nearZ), oz), iz), t0);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(farX), ox), ix), t1);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(farY), oy), iy), t1);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(farZ), oz), iz), t1);
+        hit |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(t0, t1)) << g;
+    }
+#else
+    for (int i = 0; i < RayPacket::Size; ++i) {
+        float t0 = 0, t1 = packet.tMax[i], t;
+        t = (nearX - packet.ox[i]) * packet.ix[i]; if (t > t0) t0 = t;
+        t = (nearY - packet.oy[i]) * packet.iy[i]; if (t > t0) t0 = t;
+        t = (nearZ - packet.oz[i]) * packet.iz[i]; if (t > t0) t0 = t;
+        t = (farX - packet.ox[i]) * packet.ix[i]; if (t < t1) t1 = t;
+        t = (farY - packet.oy[i]) * packet.iy[i]; if (t < t1) t1 = t;
+        t = (farZ - packet.oz[i]) * packet.iz[i]; if (t < t1) t1 = t;
+        if (t0 <= t1)
+            hit |= 1u << i;
+    }
+#endif
+    return hit & mask;
 }
 
-void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf){
-    if(node->left == nullptr || node->right == nullptr){
-        node->object->Sample(pos, pdf);
-        pdf *= node->area;
+void BVHAccel::IntersectPacket(RayPacket &packet, uint32_t mask, Intersection* hits) const
+{
+    if (nodes.empty() || !mask)
+        return;
+
+    // 单独追踪 mask 中的光线，从 nodeIndex 子树开始
+    auto traceSingle = [&](int nodeIndex, uint32_t lanes) {
+        for (int i = 0; i < RayPacket::Size; ++i) {
+            if (!(lanes & (1u << i)))
+                continue;
+            Ray r = packet.ray(i);
+            intersectSubtree(nodeIndex, r, hits[i]);
+            packet.tMax[i] = r.t_max;
+        }
+    };
+
+    // 方向符号不一致的光线包无法共用遍历顺序
+    std::array<int, 3> dirsIsNeg;
+    if (!packet.coherent(mask, dirsIsNeg)) {
+        traceSingle(0, mask);
         return;
     }
-    if(p < node->left->area) getSample(node->left, p, pos, pdf);
-    else getSample(node->right, p - node->left->area, pos, pdf);
+
+    struct { int node; uint32_t mask; } nodesToVisit[maxTreeDepth];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    while (true) {
+        const LinearBVHNode* node = &nodes[currentNodeIndex];
+        STAT_ADD(nodesVisited, 1);
+        STAT_ADD(boxTests, __builtin_popcount(mask));
+        uint32_t active = intersectPacketBox(node->bounds, packet, mask, dirsIsNeg);
+        if (active && __builtin_popcount(active) < packetMinActive) {
+            // 剩下的光线太少，包遍历不再划算
+            traceSingle(currentNodeIndex, active);
+        }
+        else if (active && node->nPrimitives > 0) {
+            intersectPacketLeaf(node->primType, node->primitivesOffset, node->nPrimitives, packet, active, hits);
+        }
+        else if (active) {
+            if (dirsIsNeg[node->axis]) {
+                nodesToVisit[toVisitOffset++] = {currentNodeIndex + 1, active};
+                currentNodeIndex = node->secondChildOffset;
+            }
+            else {
+                nodesToVisit[toVisitOffset++] = {node->secondChildOffset, active};
+                currentNodeIndex = currentNodeIndex + 1;
+            }
+            mask = active;
+            continue;
+        }
+        if (toVisitOffset == 0)
+            break;
+        --toVisitOffset;
+        currentNodeIndex = nodesToVisit[toVisitOffset].node;
+        mask = nodesToVisit[toVisitOffset].mask;
+    }
 }
 
-void BVHAccel::Sample(Intersection &pos, float &pdf){
-    float p = std::sqrt(get_random_float()) * root->area;
-    getSample(root, p, pos, pdf);
-    pdf /= root->area;
-}
\ No newline at end of file
+bool BVHAccel::IntersectP(const Ray& ray) const
+{
+    if (nodes.empty())
+        return false;
+    if (!wide4.empty())
+        return intersectPWide(wide4, ray);
+    if (!wide8.empty())
+        return intersectPWide(wide8, ray);
+
+    float x = ray.direction_inv.x;
+    float y = ray.direction_inv.y;
+    float z = ray.direction_inv.z;
+    std::array<int, 3> dirsIsNeg{int(x < 0), int(y < 0), int(z < 0)};
+    float tMax = ray.t_max;
+
+    // 只要找到任意一个遮挡就返回，不需要最近交点
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[maxTreeDepth];
+    while (true) {
+        const LinearBVHNode* node = &nodes[currentNodeIndex];
+        STAT_ADD(nodesVisited, 1);
+        STAT_ADD(boxTests, 1);
+        if (node->bounds.IntersectP(ray, ray.direction_inv, dirsIsNeg, tMax)) {
+            if (node->nPrimitives > 0) {
+                if (occludedLeaf(node->primType, node->primitivesOffset, node->nPrimitives, ray))
+                    return true;
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else {
+                if (dirsIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                }
+                else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        }
+        else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    return false;
+}
+
+void BVHAccel::Sample(Intersection &pos, float &pdf, Sampler &sampler){
+    // 先按面积挑一个图元，再在图元上均匀采样
+    float p = sampler.get1D() * totalArea;
+    const Buffer<float> &cdf = areaCdf;  // 可能是快照的只读视图
+    int i = std::upper_bound(cdf.begin(), cdf.end(), p) - cdf.begin();
+    if (mesh) {
+        i = std::min(i, (int)mesh->size() - 1);
+        mesh->sample(i, pos, pdf, sampler);
+        pdf *= mesh->getArea(i) / totalArea;
+        return;
+    }
+    i = std::min(i, (int)primitives.size() - 1);
+    Object* prim = primitives[i];
+    prim->Sample(pos, pdf, sampler);
+    pdf *= prim->getArea() / totalArea;
+}
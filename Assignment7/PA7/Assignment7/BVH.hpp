@@ -11,13 +11,53 @@
 #include <ctime>
 #include "Object.hpp"
 #include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "TriangleMesh.hpp"
+#include "Buffer.hpp"
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
 
 struct BVHBuildNode;
+class Instance;
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
+struct BVHBuildTask;
+
+// 叶节点图元类型：同一个叶节点只放一种图元，遍历时按类型直接调用对应的求交内核。
+// Triangle/Sphere/Mesh/Instance 的叶节点偏移是对应类型数组中的下标，Object 是 primitives 中的下标
+enum class PrimType : uint8_t { Object, Triangle, Sphere, Mesh, Instance, Count };
+
+// 叶节点中的球体，只保留求交需要的数据
+struct SpherePrim {
+    Vector3f center;
+    float radius2;
+    Object* obj;
+    Material* m;
+};
+
+// 构建完成后把树压平成深度优先排列的数组，左孩子紧跟在父节点后面
+struct alignas(32) LinearBVHNode {
+    Bounds3 bounds;
+    union {
+        int primitivesOffset;   // leaf
+        int secondChildOffset;  // interior
+    };
+    uint16_t nPrimitives;  // 0 -> interior node
+    uint8_t axis;          // interior node: xyz
+    uint8_t primType;      // leaf node: PrimType
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+// 由二叉树合并得到的 N 叉节点，N 个子节点的包围盒按 SoA 存放，一次 SIMD 测试全部子节点
+// bounds[0] 为 pMin，bounds[1] 为 pMax，bounds[k][axis][lane]
+template <int N>
+struct alignas(32) WideBVHNode {
+    float bounds[2][3][N];
+    int child[N];        // count == 0: 子节点下标 (-1 表示空槽); count > 0: 图元偏移
+    uint8_t count[N];    // 叶子的图元数
+    uint8_t type[N];     // 叶子的 PrimType
+};
 
 // BVHAccel Declarations
 inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
@@ -25,47 +65,118 @@ class BVHAccel {
 
 public:
     // BVHAccel Public Types
-    enum class SplitMethod { NAIVE, SAH };
+    // NAIVE: 按质心取中位数; SAH: 分桶表面积启发式; MIDDLE: 按质心包围盒中点划分，构建最快
+    enum class SplitMethod { NAIVE, SAH, MIDDLE };
 
     // BVHAccel Public Methods
-    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    // width 为 4 或 8 时额外生成宽 BVH 并用它遍历，其余值使用二叉树
+    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 4, SplitMethod splitMethod = SplitMethod::SAH,
+             int width = BVHAccel::defaultWidth);
+    // 直接在网格的三角形上构建，叶节点按下标引用 mesh 中的三角形，构建后 mesh 按叶节点顺序重排
+    BVHAccel(TriangleMesh* mesh, int maxPrimsInNode = 4, SplitMethod splitMethod = SplitMethod::SAH,
+             int width = BVHAccel::defaultWidth);
+    // 直接采用已经构建好的二叉 BVH（如映射的网格快照），mesh 的三角形必须已经按叶节点顺序排列；
+    // areaCdf 为空时按三角形面积重新累加
+    BVHAccel(TriangleMesh* mesh, Buffer<LinearBVHNode> nodes, Buffer<float> areaCdf = {},
+             int width = BVHAccel::defaultWidth);
     Bounds3 WorldBound() const;
     ~BVHAccel();
 
     Intersection Intersect(const Ray &ray) const;
-    Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
+    // 不复制光线：找到更近的交点时更新 isect 并缩短 r.t_max，上层 BVH 的网格叶节点用它下降
+    void Intersect(Ray &r, Intersection &isect) const;
+    // 遮挡查询：线段 [0, ray.t_max] 上有任意交点就返回 true
     bool IntersectP(const Ray &ray) const;
-    BVHBuildNode* root;
+    // 光线包一起遍历二叉 BVH，更新 mask 中各光线的 hits 和 packet.tMax；
+    // 方向不一致或剩余光线少于 packetMinActive 时退回单光线遍历
+    void IntersectPacket(RayPacket &packet, uint32_t mask, Intersection* hits) const;
+    static constexpr int packetMinActive = 4;
+    // 遍历用的定长栈按这个深度分配，构建时保证树深不超过它
+    static constexpr int maxTreeDepth = 64;
+
+    // 新建 BVHAccel 的默认分叉数，可由命令行 --bvh-width 修改
+    inline static int defaultWidth = 2;
 
     // BVHAccel Private Methods
-    BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    // 在 primBounds 上构建并压平，order[i] 为叶节点顺序中第 i 个图元的原下标
+    void build(const std::vector<Bounds3> &primBounds, const std::vector<uint8_t> &primTypes,
+               std::vector<uint32_t> &order);
+    // 在 primitiveInfo[start, end) 上原地划分；tasks 非空时，到达 taskDepth 层的子树
+    // 只创建占位节点并记录下来，之后交给线程池并行构建
+    BVHBuildNode* recursiveBuild(std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end,
+                                 std::atomic<int> &totalNodes, int depth = 0,
+                                 std::vector<BVHBuildTask>* tasks = nullptr, int taskDepth = 0);
+    // 返回划分位置，SAH 认为不划分更好时返回 -1
+    int partitionSAH(std::vector<BVHPrimitiveInfo> &primitiveInfo, int start, int end, int dim,
+                     const Bounds3 &bounds, const Bounds3 &centroidBounds);
+    int flattenBVHTree(BVHBuildNode* node, int* offset);
+    // 从 rootIndex 开始遍历二叉 BVH，r.t_max 和 isect 随最近交点更新
+    void intersectSubtree(int rootIndex, Ray &r, Intersection &isect) const;
+    void deleteBuildTree(BVHBuildNode* node);
+    // 叶节点中 type 类型图元 [offset, offset + count) 的求交，只有 Object 类型走虚函数
+    void intersectLeaf(uint8_t type, int offset, int count, Ray &r, Intersection &isect) const;
+    bool occludedLeaf(uint8_t type, int offset, int count, const Ray &r) const;
+    void intersectPacketLeaf(uint8_t type, int offset, int count, RayPacket &packet, uint32_t mask,
+                             Intersection *hits) const;
+    // 把二叉节点 nodeIndex 及其子树合并成 N 叉节点，返回在 wide 中的下标
+    template <int N>
+    int collapseBVH(std::vector<WideBVHNode<N>> &wide, int nodeIndex) const;
+    template <int N>
+    void intersectWide(const std::vector<WideBVHNode<N>> &wide, Ray &r, Intersection &isect) const;
+    template <int N>
+    bool intersectPWide(const std::vector<WideBVHNode<N>> &wide, const Ray &ray) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
-    std::vector<Object*> primitives;
-
-    void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
-    void Sample(Intersection &pos, float &pdf);
+    std::vector<Object*> primitives;   // 按叶节点顺序重排
+    TriangleMesh* mesh = nullptr;      // 非空时图元是 mesh 中的三角形，primitives 为空
+    std::vector<SpherePrim> spheres;           // PrimType::Sphere，按叶节点顺序
+    std::vector<const BVHAccel*> meshes;       // PrimType::Mesh，网格自己的 BVH
+    std::vector<const Instance*> instances;    // PrimType::Instance，共享底层 BVH 的实例
+    Buffer<LinearBVHNode> nodes;
+    const int width;
+    std::vector<WideBVHNode<4>> wide4;
+    std::vector<WideBVHNode<8>> wide8;
+
+    // 按面积累加的 CDF，用于在所有图元上按面积均匀采样
+    Buffer<float> areaCdf;
+    float totalArea = 0;
+
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler);
 };
 
 struct BVHBuildNode {
     Bounds3 bounds;
     BVHBuildNode *left;
     BVHBuildNode *right;
-    Object* object;
-    float area;
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0;
+    uint8_t primType=0;
     // BVHBuildNode Public Methods
     BVHBuildNode(){
         bounds = Bounds3();
         left = nullptr;right = nullptr;
-        object = nullptr;
     }
 };
 
+struct BVHPrimitiveInfo {
+    BVHPrimitiveInfo() {}
+    BVHPrimitiveInfo(size_t primitiveNumber, const Bounds3 &bounds, uint8_t type = 0)
+        : primitiveNumber(primitiveNumber), bounds(bounds),
+          centroid(.5f * bounds.pMin + .5f * bounds.pMax), type(type) {}
+    size_t primitiveNumber;
+    Bounds3 bounds;
+    Vector3f centroid;
+    uint8_t type;
+};
+
+struct BVHBuildTask {
+    BVHBuildNode* node;
+    int start, end;
+};
+
 
 
 
@@ -85,36 +85,44 @@ class Bounds3
     }
 
     inline bool IntersectP(const Ray& ray, const Vector3f& invDir,
-                           const std::array<int, 3>& dirisNeg) const;
+                           const std::array<int, 3>& dirisNeg,
+                           float tMax = std::numeric_limits<float>::infinity()) const;
 };
 
 
 
 inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir,
-                                const std::array<int, 3>& dirIsNeg) const
+                                const std::array<int, 3>& dirIsNeg, float tMax) const
 {
     // invDir: ray direction(x,y,z), invDir=(1.0/x,1.0/y,1.0/z), use this because Multiply is faster that Division
-    // dirIsNeg: ray direction(x,y,z), dirIsNeg=[int(x>0),int(y>0),int(z>0)], use this to simplify your logic
-    // TODO test if ray bound intersects
-
+    // dirIsNeg: ray direction(x,y,z), dirIsNeg=[int(x<0),int(y<0),int(z<0)], use this to simplify your logic
+    // tMax: 已找到的最近交点距离，进入点比它远的包围盒直接跳过
+
+    // 方向为负时，进入面是 pMax
+    const Vector3f& nearX = (*this)[dirIsNeg[0]];
+    const Vector3f& farX = (*this)[1 - dirIsNeg[0]];
+    const Vector3f& nearY = (*this)[dirIsNeg[1]];
+    const Vector3f& farY = (*this)[1 - dirIsNeg[1]];
+    const Vector3f& nearZ = (*this)[dirIsNeg[2]];
+    const Vector3f& farZ = (*this)[1 - dirIsNeg[2]];
+
+    float tx0 = (nearX.x - ray.origin.x) * invDir.x, tx1 = (farX.x - ray.origin.x) * invDir.x;
+    float ty0 = (nearY.y - ray.origin.y) * invDir.y, ty1 = (farY.y - ray.origin.y) * invDir.y;
+    float tz0 = (nearZ.z - ray.origin.z) * invDir.z, tz1 = (farZ.z - ray.origin.z) * invDir.z;
+
+    // 方向分量为 0 且起点在平面上时会得到 0 * inf = NaN，比较结果为 false，该轴被忽略
     //光线进入点
     float tEnter = -std::numeric_limits<float>::infinity();
+    if (tx0 > tEnter) tEnter = tx0;
+    if (ty0 > tEnter) tEnter = ty0;
+    if (tz0 > tEnter) tEnter = tz0;
     //光线离开点
     float tExit = std::numeric_limits<float>::infinity();
+    if (tx1 < tExit) tExit = tx1;
+    if (ty1 < tExit) tExit = ty1;
+    if (tz1 < tExit) tExit = tz1;
 
-    for (int i = 0; i < 3; i++)
-    {
-        float min = (pMin[i] - ray.origin[i]) * invDir[i];
-        float max = (pMax[i] - ray.origin[i]) * invDir[i];
-        // 坐标为负时，需要交换
-        if(!dirIsNeg[i])
-        {
-            std::swap(min, max);
-        }
-        tEnter = std::max(min, tEnter);
-        tExit = std::min(max, tExit);
-    }
-    return tEnter <= tExit && tExit >= 0;
+    return tEnter <= tExit && tExit >= 0 && tEnter <= tMax;
 }
 
 inline Bounds3 Union(const Bounds3& b1, const Bounds3& b2)
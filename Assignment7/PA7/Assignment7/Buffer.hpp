@@ -0,0 +1,97 @@
+//
+// Contiguous array that owns its elements or views read-only memory such as a mapped snapshot.
+//
+
+#ifndef RAYTRACING_BUFFER_H
+#define RAYTRACING_BUFFER_H
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// 构建时像 std::vector 一样持有并修改数据；view() 之后改为直接使用别处的只读内存
+// （mmap 映射的快照文件），不复制也不修正指针。读取都经过同一个指针，两种情况没有区别。
+// 修改操作 (resize / push_back / 非 const 的元素访问) 只能用于自己持有数据的 Buffer
+template <typename T>
+class Buffer
+{
+public:
+    Buffer() = default;
+    Buffer(std::vector<T> v) : owned(std::move(v)) { sync(); }
+    Buffer(const Buffer &b) : owned(b.owned) { adopt(b); }
+    Buffer(Buffer &&b) noexcept : owned(std::move(b.owned)) { adopt(b); b.clear(); }
+
+    Buffer &operator=(const Buffer &b)
+    {
+        owned = b.owned;
+        adopt(b);
+        return *this;
+    }
+
+    Buffer &operator=(Buffer &&b) noexcept
+    {
+        owned = std::move(b.owned);
+        adopt(b);
+        b.clear();
+        return *this;
+    }
+
+    // 指向外部的 count 个元素，调用者保证这块内存比 Buffer 活得久
+    void view(const T* data, size_t count)
+    {
+        owned.clear();
+        owned.shrink_to_fit();
+        ptr = data;
+        n = count;
+        external = true;
+    }
+
+    bool isView() const { return external; }
+
+    void resize(size_t count) { assert(!external); owned.resize(count); sync(); }
+    void reserve(size_t count) { assert(!external); owned.reserve(count); sync(); }
+    void push_back(const T &v) { assert(!external); owned.push_back(v); sync(); }
+    void clear() { owned.clear(); owned.shrink_to_fit(); sync(); }
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const T* data() const { return ptr; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+    const T &back() const { return ptr[n - 1]; }
+
+    // 可写访问只用于自己持有的数据；视图指向 PROT_READ 映射，只读的调用者应通过 const 引用访问
+    T &operator[](size_t i) { assert(!external); return owned[i]; }
+    T* begin() { assert(!external); return owned.data(); }
+    T* end() { assert(!external); return owned.data() + owned.size(); }
+
+private:
+    void sync()
+    {
+        ptr = owned.data();
+        n = owned.size();
+        external = false;
+    }
+
+    // 复制或移动 b 之后：b 是视图就指向同一块外部内存，否则指向刚得到的 owned
+    void adopt(const Buffer &b)
+    {
+        if (b.external) {
+            ptr = b.ptr;
+            n = b.n;
+            external = true;
+        }
+        else {
+            sync();
+        }
+    }
+
+    std::vector<T> owned;
+    const T* ptr = nullptr;
+    size_t n = 0;
+    bool external = false;
+};
+
+#endif //RAYTRACING_BUFFER_H
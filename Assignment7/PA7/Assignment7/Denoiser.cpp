@@ -0,0 +1,149 @@
+//
+// Edge-avoiding a-trous wavelet denoiser guided by first-hit feature buffers.
+//
+
+#include <cmath>
+#include <limits>
+#include "Denoiser.hpp"
+#include "ThreadPool.hpp"
+
+static inline float luminance(const Vector3f &c) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
+// 除以 albedo 时的下限，去调制和重新调制用同一个值，保证能原样还原
+static inline Vector3f safeAlbedo(const Vector3f &a)
+{
+    return Vector3f(std::max(a.x, 0.01f), std::max(a.y, 0.01f), std::max(a.z, 0.01f));
+}
+
+struct Denoiser::Buffers
+{
+    int width, height;
+    const std::vector<Vector3f> &albedo, &normal;
+    const std::vector<float> &depth;
+    std::vector<float> dzdx, dzdy;    // 深度在屏幕上的梯度，不跨越深度不连续处
+};
+
+void Denoiser::pass(const Buffers &buf, int step, const std::vector<Vector3f> &in, const std::vector<float> &varIn,
+                    std::vector<Vector3f> &out, std::vector<float> &varOut, int rowStart, int rowEnd) const
+{
+    static const float kernel[3] = {3.0f / 8, 1.0f / 4, 1.0f / 16};
+    static const float gauss[2] = {1.0f / 2, 1.0f / 4};
+    const int w = buf.width, h = buf.height;
+
+    for (int y = rowStart; y < rowEnd; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int p = y * w + x;
+            float zp = buf.depth[p];
+            if (!std::isfinite(zp)) {
+                // 没打中物体的像素不参与滤波
+                out[p] = in[p];
+                varOut[p] = varIn[p];
+                continue;
+            }
+
+            // 方差先做 3x3 高斯模糊，避免单个像素的方差估计太小把权重卡死
+            float var = 0, gsum = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int qx = x + dx, qy = y + dy;
+                    if (qx < 0 || qx >= w || qy < 0 || qy >= h)
+                        continue;
+                    float g = gauss[std::abs(dx)] * gauss[std::abs(dy)];
+                    var += g * varIn[qy * w + qx];
+                    gsum += g;
+                }
+            }
+            float sigmaL = sigmaLuminance * std::sqrt(std::max(var / gsum, 0.0f)) + 1e-6f;
+
+            const Vector3f &np = buf.normal[p], &ap = buf.albedo[p];
+            float lp = luminance(in[p]);
+            Vector3f sum(0.0f);
+            float wsum = 0, vsum = 0;
+            for (int dy = -2; dy <= 2; ++dy) {
+                for (int dx = -2; dx <= 2; ++dx) {
+                    int qx = x + dx * step, qy = y + dy * step;
+                    if (qx < 0 || qx >= w || qy < 0 || qy >= h)
+                        continue;
+                    int q = qy * w + qx;
+                    float zq = buf.depth[q];
+                    if (!std::isfinite(zq))
+                        continue;
+
+                    float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                    if (q != p) {
+                        float wl = std::fabs(lp - luminance(in[q])) / sigmaL;
+                        float wn = std::pow(std::max(0.0f, dotProduct(np, buf.normal[q])), sigmaNormal);
+                        float dz = buf.dzdx[p] * (qx - x) + buf.dzdy[p] * (qy - y);
+                        float wz = std::fabs(zp - zq) / (sigmaDepth * std::fabs(dz) + 1e-3f * zp);
+                        Vector3f da = ap - buf.albedo[q];
+                        float wa = dotProduct(da, da) / (sigmaAlbedo * sigmaAlbedo);
+                        weight *= wn * std::exp(-wl - wz - wa);
+                    }
+                    sum += weight * in[q];
+                    wsum += weight;
+                    vsum += weight * weight * varIn[q];
+                }
+            }
+            out[p] = sum / wsum;
+            varOut[p] = vsum / (wsum * wsum);
+        }
+    }
+}
+
+std::vector<Vector3f> Denoiser::run(const Film &film) const
+{
+    const int w = film.width, h = film.height;
+    std::vector<Vector3f> color(w * h);
+    std::vector<float> variance(w * h);
+    Buffers buf{w, h, film.albedo, film.normal, film.depth, std::vector<float>(w * h, 0.0f),
+                std::vector<float>(w * h, 0.0f)};
+
+    for (int p = 0; p < w * h; ++p) {
+        Vector3f a = safeAlbedo(film.albedo[p]);
+        Vector3f c = film.getPixel(p);
+        color[p] = Vector3f(c.x / a.x, c.y / a.y, c.z / a.z);
+
+        // 像素均值的方差 = 样本方差 / 样本数；样本不足 2 个时按相对误差 100% 估计
+        uint32_t n = film.count[p];
+        float var = n >= 2 ? film.m2[p] / (n - 1) / n : luminance(c) * luminance(c);
+        float la = luminance(a);
+        variance[p] = var / (la * la);
+    }
+
+    // 深度梯度取前向、后向差分中绝对值较小的一个
+    const float inf = std::numeric_limits<float>::infinity();
+    auto gradient = [&](int p, int prev, int next) {
+        float z = film.depth[p];
+        float back = prev >= 0 && std::isfinite(film.depth[prev]) ? z - film.depth[prev] : inf;
+        float forward = next >= 0 && std::isfinite(film.depth[next]) ? film.depth[next] - z : inf;
+        float g = std::fabs(back) < std::fabs(forward) ? back : forward;
+        return std::isfinite(g) ? g : 0.0f;
+    };
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int p = y * w + x;
+            if (!std::isfinite(film.depth[p]))
+                continue;
+            buf.dzdx[p] = gradient(p, x > 0 ? p - 1 : -1, x + 1 < w ? p + 1 : -1);
+            buf.dzdy[p] = gradient(p, y > 0 ? p - w : -1, y + 1 < h ? p + w : -1);
+        }
+    }
+
+    // 每次迭代按 16 行一块分给线程池，两组缓冲交替读写
+    std::vector<Vector3f> color2(w * h);
+    std::vector<float> variance2(w * h);
+    const int rowsPerTask = 16;
+    int tasks = (h + rowsPerTask - 1) / rowsPerTask;
+    for (int i = 0; i < iterations; ++i) {
+        ThreadPool::global().parallelFor(tasks, [&](int task, int) {
+            pass(buf, 1 << i, color, variance, color2, variance2, task * rowsPerTask,
+                 std::min(h, (task + 1) * rowsPerTask));
+        });
+        color.swap(color2);
+        variance.swap(variance2);
+    }
+
+    for (int p = 0; p < w * h; ++p)
+        color[p] = color[p] * safeAlbedo(film.albedo[p]);
+    return color;
+}
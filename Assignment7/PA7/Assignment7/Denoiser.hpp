@@ -0,0 +1,35 @@
+//
+// Edge-avoiding a-trous wavelet denoiser guided by first-hit feature buffers.
+//
+
+#ifndef RAYTRACING_DENOISER_H
+#define RAYTRACING_DENOISER_H
+
+#include <vector>
+#include "Film.hpp"
+#include "Vector.hpp"
+
+// 边缘保持的 a-trous 小波滤波 (Dammertz 2010)，亮度权重按像素方差调节 (SVGF)。
+// 颜色先除以 albedo 得到光照，滤波后再乘回去，纹理和物体颜色的边界不会被模糊。
+// 第 i 次迭代用间隔 2^i 的 5x5 B3 样条核，相邻像素的权重为
+//   exp(-|l_p - l_q| / (sigmaLuminance * sqrt(var_p))) x 法线 x 深度 x albedo
+// 方差随每次迭代一起滤波。
+class Denoiser
+{
+public:
+    int iterations = 5;
+    float sigmaLuminance = 4.0f;   // 亮度差按像素标准差的倍数容忍
+    float sigmaNormal = 128.0f;    // 法线权重 max(0, n_p . n_q)^sigmaNormal
+    float sigmaDepth = 1.0f;       // 深度差按深度梯度外推值的倍数容忍
+    float sigmaAlbedo = 0.1f;
+
+    // film 需要已填好特征缓冲，返回去噪后的颜色
+    std::vector<Vector3f> run(const Film &film) const;
+
+private:
+    struct Buffers;
+    void pass(const Buffers &buf, int step, const std::vector<Vector3f> &in, const std::vector<float> &varIn,
+              std::vector<Vector3f> &out, std::vector<float> &varOut, int rowStart, int rowEnd) const;
+};
+
+#endif //RAYTRACING_DENOISER_H
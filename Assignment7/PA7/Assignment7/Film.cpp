@@ -0,0 +1,122 @@
+//
+// Accumulation buffer for progressive rendering.
+//
+
+#include <cstdio>
+#include <cstring>
+#include "Film.hpp"
+#include "global.hpp"
+
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be tightly packed");
+
+static const char checkpointMagic[4] = {'P', 'T', 'C', 'K'};
+static const uint32_t checkpointVersion = 2;
+
+uint32_t Film::minCount() const
+{
+    uint32_t n = UINT32_MAX;
+    for (auto c : count)
+        n = std::min(n, c);
+    return count.empty() ? 0 : n;
+}
+
+uint64_t Film::totalSamples() const
+{
+    uint64_t n = 0;
+    for (auto c : count)
+        n += c;
+    return n;
+}
+
+bool Film::saveCheckpoint(const std::string &path) const
+{
+    std::string tmp = path + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    int32_t size[2] = {width, height};
+    bool ok = fwrite(checkpointMagic, 1, 4, fp) == 4 &&
+              fwrite(&checkpointVersion, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(size, sizeof(int32_t), 2, fp) == 2 &&
+              fwrite(sum.data(), sizeof(Vector3f), sum.size(), fp) == sum.size() &&
+              fwrite(count.data(), sizeof(uint32_t), count.size(), fp) == count.size() &&
+              fwrite(mean.data(), sizeof(float), mean.size(), fp) == mean.size() &&
+              fwrite(m2.data(), sizeof(float), m2.size(), fp) == m2.size();
+    ok = (fflush(fp) == 0) && ok;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Film::loadCheckpoint(const std::string &path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    int32_t size[2] = {0, 0};
+    bool ok = fread(magic, 1, 4, fp) == 4 && memcmp(magic, checkpointMagic, 4) == 0 &&
+              fread(&version, sizeof(uint32_t), 1, fp) == 1 && version == checkpointVersion &&
+              fread(size, sizeof(int32_t), 2, fp) == 2 && size[0] == width && size[1] == height;
+
+    std::vector<Vector3f> s(sum.size());
+    std::vector<uint32_t> c(count.size());
+    std::vector<float> mu(mean.size()), var(m2.size());
+    ok = ok && fread(s.data(), sizeof(Vector3f), s.size(), fp) == s.size() &&
+         fread(c.data(), sizeof(uint32_t), c.size(), fp) == c.size() &&
+         fread(mu.data(), sizeof(float), mu.size(), fp) == mu.size() &&
+         fread(var.data(), sizeof(float), var.size(), fp) == var.size();
+    fclose(fp);
+
+    if (!ok)
+        return false;
+    sum.swap(s);
+    count.swap(c);
+    mean.swap(mu);
+    m2.swap(var);
+    return true;
+}
+
+std::vector<Vector3f> Film::getPixels() const
+{
+    std::vector<Vector3f> pixels(width * height);
+    for (auto i = 0; i < height * width; ++i)
+        pixels[i] = getPixel(i);
+    return pixels;
+}
+
+void Film::writePPM(const std::string &path) const
+{
+    ::writePPM(path, width, height, getPixels());
+}
+
+bool Film::writeHDR(const std::string &path) const
+{
+    return ::writeHDR(path, width, height, getPixels());
+}
+
+void Film::writeFeatures(const std::string &prefix) const
+{
+    if (albedo.empty())
+        return;
+    // 法线映射到 [0, 1]，深度按最远的交点归一化，都按线性值写出
+    std::vector<Vector3f> n(normal.size()), d(depth.size());
+    float maxDepth = 0;
+    for (float z : depth)
+        if (std::isfinite(z))
+            maxDepth = std::max(maxDepth, z);
+    for (size_t i = 0; i < normal.size(); ++i) {
+        n[i] = 0.5f * normal[i] + Vector3f(0.5f);
+        d[i] = Vector3f(std::isfinite(depth[i]) && maxDepth > 0 ? depth[i] / maxDepth : 1.0f);
+    }
+    ::writePPM(prefix + "albedo.ppm", width, height, albedo, 1.0f);
+    ::writePPM(prefix + "normal.ppm", width, height, n, 1.0f);
+    ::writePPM(prefix + "depth.ppm", width, height, d, 1.0f);
+}
@@ -0,0 +1,76 @@
+//
+// Accumulation buffer for progressive rendering.
+//
+
+#ifndef RAYTRACING_FILM_H
+#define RAYTRACING_FILM_H
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "ImageIO.hpp"
+#include "Vector.hpp"
+
+class Film
+{
+public:
+    Film(int w, int h) : width(w), height(h), sum(w * h), count(w * h, 0), mean(w * h, 0.f), m2(w * h, 0.f) {}
+
+    void addSample(int pixel, const Vector3f &L)
+    {
+        sum[pixel] += L;
+        uint32_t n = ++count[pixel];
+
+        // Welford 在线方差，统计亮度
+        float y = 0.2126f * L.x + 0.7152f * L.y + 0.0722f * L.z;
+        float delta = y - mean[pixel];
+        mean[pixel] += delta / n;
+        m2[pixel] += delta * (y - mean[pixel]);
+    }
+
+    // 像素均值的相对标准误差，样本数不足 2 时返回无穷大
+    float relativeError(int pixel) const
+    {
+        uint32_t n = count[pixel];
+        if (n < 2)
+            return std::numeric_limits<float>::infinity();
+        float variance = m2[pixel] / (n - 1);
+        float stdErr = std::sqrt(variance / n);
+        return stdErr / std::max(mean[pixel], 1e-3f);
+    }
+
+    Vector3f getPixel(int pixel) const
+    {
+        return count[pixel] ? sum[pixel] / (float)count[pixel] : Vector3f(0);
+    }
+
+    // 所有像素的均值，按行存放
+    std::vector<Vector3f> getPixels() const;
+
+    uint32_t minCount() const;
+    uint64_t totalSamples() const;
+
+    // 断点文件：先写 path.tmp 再 rename，进程被杀掉也不会留下半个文件
+    bool saveCheckpoint(const std::string &path) const;
+    // 文件不存在或尺寸不匹配时返回 false，film 保持不变
+    bool loadCheckpoint(const std::string &path);
+
+    void writePPM(const std::string &path) const;
+    // 不经 clamp 和 gamma 写出浮点辐射度，按扩展名选择 PFM 或 EXR
+    bool writeHDR(const std::string &path) const;
+    // 写出 albedo.ppm、normal.ppm、depth.ppm（文件名加 prefix 前缀）
+    void writeFeatures(const std::string &prefix) const;
+
+    int width, height;
+    std::vector<Vector3f> sum;      // 每个像素的辐射度累加值
+    std::vector<uint32_t> count;    // 每个像素已完成的样本数
+    std::vector<float> mean, m2;    // 亮度的均值和离差平方和 (Welford)
+
+    // 第一个交点的特征缓冲，供去噪使用；只在需要时由 Renderer 填写，未打中物体的像素深度为无穷大
+    std::vector<Vector3f> albedo, normal;
+    std::vector<float> depth;
+};
+
+#endif //RAYTRACING_FILM_H
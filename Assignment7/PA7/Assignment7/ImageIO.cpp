@@ -0,0 +1,143 @@
+//
+// Image file writers: 8-bit PPM and float PFM/OpenEXR framebuffers.
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "ImageIO.hpp"
+#include "global.hpp"
+
+void writePPM(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels, float gamma)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return;
+    (void)fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (auto i = 0; i < height * width; ++i) {
+        const Vector3f &c = pixels[i];
+        unsigned char color[3];
+        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, c.x), gamma));
+        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, c.y), gamma));
+        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, c.z), gamma));
+        fwrite(color, 1, 3, fp);
+    }
+    fclose(fp);
+}
+
+bool writePFM(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+    // 比例因子为负表示小端
+    bool ok = fprintf(fp, "PF\n%d %d\n-1.0\n", width, height) > 0;
+    for (int y = height - 1; ok && y >= 0; --y)
+        ok = fwrite(&pixels[y * width], sizeof(Vector3f), width, fp) == (size_t)width;
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+bool readPFM(const std::string &path, int &width, int &height, std::vector<Vector3f> &pixels)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+    char magic[3] = {0};
+    float scale = 0;
+    bool ok = fscanf(fp, "%2s %d %d %f", magic, &width, &height, &scale) == 4 && !strcmp(magic, "PF") &&
+              width > 0 && height > 0 && fgetc(fp) != EOF;
+    if (ok) {
+        pixels.resize((size_t)width * height);
+        for (int y = height - 1; ok && y >= 0; --y)
+            ok = fread(&pixels[y * width], sizeof(Vector3f), width, fp) == (size_t)width;
+    }
+    fclose(fp);
+    if (!ok)
+        return false;
+
+    // 比例因子为正表示大端，逐个浮点数翻转字节
+    if (scale > 0) {
+        for (Vector3f &p : pixels) {
+            for (int c = 0; c < 3; ++c) {
+                unsigned char* b = reinterpret_cast<unsigned char*>(&p[c]);
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+        }
+    }
+    return true;
+}
+
+// EXR 头部的一个属性：名字、类型、数据长度和数据
+static void exrAttribute(std::vector<char> &header, const char* name, const char* type, const void* data,
+                         int32_t size)
+{
+    header.insert(header.end(), name, name + strlen(name) + 1);
+    header.insert(header.end(), type, type + strlen(type) + 1);
+    const char* s = reinterpret_cast<const char*>(&size);
+    header.insert(header.end(), s, s + 4);
+    const char* d = static_cast<const char*>(data);
+    header.insert(header.end(), d, d + size);
+}
+
+bool writeEXR(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels)
+{
+    // 通道按名字排序存放：B, G, R；类型 2 = FLOAT，xSampling = ySampling = 1
+    std::vector<char> channels;
+    for (const char* name : {"B", "G", "R"}) {
+        int32_t desc[4] = {2, 0, 1, 1};   // pixelType, pLinear + 3 字节保留, xSampling, ySampling
+        channels.insert(channels.end(), name, name + 2);
+        channels.insert(channels.end(), reinterpret_cast<char*>(desc), reinterpret_cast<char*>(desc) + 16);
+    }
+    channels.push_back(0);
+
+    int32_t window[4] = {0, 0, width - 1, height - 1};
+    unsigned char compression = 0, lineOrder = 0;   // NO_COMPRESSION, INCREASING_Y
+    float aspect = 1.0f, center[2] = {0, 0}, screenWidth = 1.0f;
+
+    std::vector<char> header = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+    exrAttribute(header, "channels", "chlist", channels.data(), channels.size());
+    exrAttribute(header, "compression", "compression", &compression, 1);
+    exrAttribute(header, "dataWindow", "box2i", window, 16);
+    exrAttribute(header, "displayWindow", "box2i", window, 16);
+    exrAttribute(header, "lineOrder", "lineOrder", &lineOrder, 1);
+    exrAttribute(header, "pixelAspectRatio", "float", &aspect, 4);
+    exrAttribute(header, "screenWindowCenter", "v2f", center, 8);
+    exrAttribute(header, "screenWindowWidth", "float", &screenWidth, 4);
+    header.push_back(0);
+
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    // 偏移表记录每一行数据块在文件中的位置；每块为 行号、数据字节数、各通道的一行浮点数
+    int32_t blockBytes = 3 * width * sizeof(float);
+    std::vector<uint64_t> offsets(height);
+    uint64_t offset = header.size() + height * sizeof(uint64_t);
+    for (int y = 0; y < height; ++y, offset += 8 + blockBytes)
+        offsets[y] = offset;
+    bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size() &&
+              fwrite(offsets.data(), sizeof(uint64_t), height, fp) == (size_t)height;
+
+    std::vector<float> block(3 * width);
+    for (int32_t y = 0; ok && y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const Vector3f &p = pixels[y * width + x];
+            block[x] = p.z;
+            block[width + x] = p.y;
+            block[2 * width + x] = p.x;
+        }
+        ok = fwrite(&y, 4, 1, fp) == 1 && fwrite(&blockBytes, 4, 1, fp) == 1 &&
+             fwrite(block.data(), sizeof(float), block.size(), fp) == block.size();
+    }
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+bool writeHDR(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels)
+{
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0)
+        return writeEXR(path, width, height, pixels);
+    return writePFM(path, width, height, pixels);
+}
@@ -0,0 +1,29 @@
+//
+// Image file writers: 8-bit PPM and float PFM/OpenEXR framebuffers.
+//
+
+#ifndef RAYTRACING_IMAGEIO_H
+#define RAYTRACING_IMAGEIO_H
+
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+
+// pixels 都按行从上到下存放，共 width * height 个
+
+// 逐通道 clamp 到 [0, 1] 后做 gamma 校正写成 8 位 PPM
+void writePPM(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels,
+              float gamma = 0.6f);
+
+// PFM：每通道 32 位浮点，小端，文件中从最下面一行开始存
+bool writePFM(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels);
+// 只读 RGB 的 PFM ("PF")，按文件头中比例因子的符号处理字节序
+bool readPFM(const std::string &path, int &width, int &height, std::vector<Vector3f> &pixels);
+
+// 最小的 OpenEXR 写出：单部分扫描线文件，无压缩，B/G/R 三个 32 位浮点通道
+bool writeEXR(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels);
+
+// 按扩展名写 .exr 或 .pfm（其它扩展名按 PFM 写）
+bool writeHDR(const std::string &path, int width, int height, const std::vector<Vector3f> &pixels);
+
+#endif //RAYTRACING_IMAGEIO_H
@@ -0,0 +1,116 @@
+//
+// Transformed reference to a shared mesh and its bottom-level BVH.
+//
+
+#ifndef RAYTRACING_INSTANCE_H
+#define RAYTRACING_INSTANCE_H
+
+#include "Object.hpp"
+#include "BVH.hpp"
+#include "Transform.hpp"
+
+// 网格实例：多个实例共享同一个 MeshTriangle 的三角形和 BVH，只各自保存变换和材质。
+// 光线在实例边界变换到物体空间，方向不归一化，所以两边的 t 相同，可以直接比较和裁剪
+class Instance : public Object
+{
+public:
+    // mt 为空时沿用原型网格的材质
+    Instance(Object* prototype, const Transform &objectToWorld, Material* mt = nullptr)
+        : prototype(prototype), accel(prototype->getAccel()), objectToWorld(objectToWorld),
+          worldToObject(objectToWorld.inverse()), m(mt)
+    {
+        worldBounds = objectToWorld.bounds(prototype->getBounds());
+        // 世界空间面积逐个三角形计算，非均匀缩放时也正确
+        area = 0;
+        const TriangleMesh* mesh = accel ? accel->mesh : nullptr;
+        if (mesh) {
+            for (size_t i = 0; i < mesh->size(); ++i) {
+                Vector3f v0, e1, e2;
+                mesh->getVertices(i, v0, e1, e2);
+                area += crossProduct(objectToWorld.vector(e1), objectToWorld.vector(e2)).norm() * 0.5f;
+            }
+        }
+        else {
+            area = prototype->getArea() * std::pow(std::fabs(objectToWorld.det()), 2.f / 3.f);
+        }
+    }
+
+    // 最近交点：找到比 isect 更近的交点时更新 isect 并缩短 r.t_max
+    void intersect(Ray &r, Intersection &isect) const
+    {
+        Ray objRay(worldToObject.point(r.origin), worldToObject.vector(r.direction));
+        objRay.t_max = r.t_max;
+        Intersection hit;
+        hit.distance = isect.distance;
+        accel->Intersect(objRay, hit);
+        if (!hit.happened)
+            return;
+        isect.happened = true;
+        isect.distance = hit.distance;
+        isect.coords = r(hit.distance);
+        isect.normal = normalize(worldToObject.normal(hit.normal));
+        isect.m = m ? m : hit.m;
+        isect.obj = const_cast<Instance*>(this);
+        isect.primIndex = hit.primIndex;
+        r.t_max = hit.distance;
+    }
+
+    bool occluded(const Ray &r) const
+    {
+        Ray objRay(worldToObject.point(r.origin), worldToObject.vector(r.direction));
+        objRay.t_max = r.t_max;
+        return accel->IntersectP(objRay);
+    }
+
+    bool intersect(const Ray& ray) { return occluded(ray); }
+    bool intersect(const Ray& ray, float &tnear, uint32_t &index) const
+    {
+        Ray r = ray;
+        Intersection isect;
+        intersect(r, isect);
+        if (!isect.happened)
+            return false;
+        tnear = isect.distance;
+        index = isect.primIndex;
+        return true;
+    }
+    Intersection getIntersection(Ray ray)
+    {
+        Intersection isect;
+        intersect(ray, isect);
+        return isect;
+    }
+    // 在物体空间向原型查询，法线和 intersect 一样用逆转置变换回世界空间
+    void getSurfaceProperties(const Vector3f &P, const Vector3f &I, const uint32_t &index, const Vector2f &uv,
+                              Vector3f &N, Vector2f &st) const
+    {
+        Vector3f objN;
+        prototype->getSurfaceProperties(worldToObject.point(P), worldToObject.vector(I), index, uv, objN, st);
+        N = normalize(worldToObject.normal(objN));
+    }
+    Vector3f evalDiffuseColor(const Vector2f &) const { return Vector3f(0.5, 0.5, 0.5); }
+    Bounds3 getBounds() { return worldBounds; }
+    float getArea() { return area; }
+
+    // 在原型上按物体空间面积采样再变换到世界空间，pdf 除以该点的面积缩放 |det M| |M^-T n|
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler)
+    {
+        prototype->Sample(pos, pdf, sampler);
+        Vector3f n = worldToObject.normal(pos.normal);
+        pdf /= std::fabs(objectToWorld.det()) * n.norm();
+        pos.coords = objectToWorld.point(pos.coords);
+        pos.normal = normalize(n);
+        if (m)
+            pos.emit = m->getEmission();
+    }
+    bool hasEmit() { return m ? m->hasEmission() : prototype->hasEmit(); }
+
+    Object* prototype;
+    const BVHAccel* accel;
+    Transform objectToWorld, worldToObject;
+    Bounds3 worldBounds;
+    float area;
+    Material* m;
+};
+
+#endif //RAYTRACING_INSTANCE_H
@@ -4,6 +4,7 @@
 
 #ifndef RAYTRACING_INTERSECTION_H
 #define RAYTRACING_INTERSECTION_H
+#include <cstdint>
 #include "Vector.hpp"
 #include "Material.hpp"
 class Object;
@@ -18,6 +19,7 @@ struct Intersection
         distance= std::numeric_limits<double>::max();
         obj =nullptr;
         m=nullptr;
+        primIndex=0;
     }
     bool happened;
     Vector3f coords;
@@ -27,5 +29,6 @@ struct Intersection
     double distance;
     Object* obj;
     Material* m;
+    uint32_t primIndex;     // 网格中三角形的编号，其它物体为 0
 };
 #endif //RAYTRACING_INTERSECTION_H
@@ -0,0 +1,290 @@
+//
+// Light BVH: importance-samples emissive primitives per shading point.
+//
+
+#include <algorithm>
+#include "LightBVH.hpp"
+#include "Instance.hpp"
+
+static inline float safeSqrt(float x) { return std::sqrt(std::max(0.f, x)); }
+static inline float safeAcos(float x) { return std::acos(clamp(-1, 1, x)); }
+
+// cos(max(0, a - b))，a、b 以正弦余弦给出
+static inline float cosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if (cosA > cosB)
+        return 1;
+    return cosA * cosB + sinA * sinB;
+}
+
+// sin(max(0, a - b))
+static inline float sinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    if (cosA > cosB)
+        return 0;
+    return sinA * cosB - cosA * sinB;
+}
+
+float LightBounds::importance(const Vector3f &p, const Vector3f &n) const
+{
+    Vector3f pc = 0.5f * bounds.pMin + 0.5f * bounds.pMax;
+    Vector3f d = p - pc;
+    float d2 = dotProduct(d, d);
+    d2 = std::max(d2, bounds.Diagonal().norm() / 2);
+    Vector3f wi = normalize(d);
+
+    // 包围盒在 p 点张开的圆锥 (半角 theta_b)，p 在包围盒内时为整个球面
+    float cosTheta_b = -1;
+    float r2 = dotProduct(bounds.Diagonal(), bounds.Diagonal()) / 4;
+    if (dotProduct(d, d) > r2)
+        cosTheta_b = safeSqrt(1 - r2 / dotProduct(d, d));
+    float sinTheta_b = safeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // 发光方向与 p 方向的最小夹角 theta' = max(0, theta_w - theta_o - theta_b)
+    float cosTheta_w = dotProduct(w, wi);
+    float sinTheta_w = safeSqrt(1 - cosTheta_w * cosTheta_w);
+    float sinTheta_o = safeSqrt(1 - cosTheta_o * cosTheta_o);
+    float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= cosTheta_e)
+        return 0;
+    float result = phi * cosThetap / d2;
+
+    // 着色面只接收法线一侧的光：光源方向 -wi 与 n 的最小夹角超过 90 度时整组光源都照不到
+    if (n.x != 0 || n.y != 0 || n.z != 0) {
+        float cosTheta_i = dotProduct(-wi, n);
+        float sinTheta_i = safeSqrt(1 - cosTheta_i * cosTheta_i);
+        result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+    return std::max(result, 0.f);
+}
+
+LightBounds Union(const LightBounds &a, const LightBounds &b)
+{
+    if (a.phi == 0)
+        return b;
+    if (b.phi == 0)
+        return a;
+
+    LightBounds r;
+    r.bounds = Union(a.bounds, b.bounds);
+    r.phi = a.phi + b.phi;
+    r.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+
+    // 合并两个方向锥
+    float theta_a = safeAcos(a.cosTheta_o), theta_b = safeAcos(b.cosTheta_o);
+    float theta_d = safeAcos(dotProduct(a.w, b.w));
+    if (std::min(theta_d + theta_b, (float)M_PI) <= theta_a) {
+        r.w = a.w;
+        r.cosTheta_o = a.cosTheta_o;
+        return r;
+    }
+    if (std::min(theta_d + theta_a, (float)M_PI) <= theta_b) {
+        r.w = b.w;
+        r.cosTheta_o = b.cosTheta_o;
+        return r;
+    }
+    float theta_o = (theta_a + theta_d + theta_b) / 2;
+    Vector3f wr = crossProduct(a.w, b.w);
+    if (theta_o >= M_PI || dotProduct(wr, wr) == 0) {
+        r.w = a.w;
+        r.cosTheta_o = -1;
+        return r;
+    }
+    r.w = normalize(Transform::rotate(wr, (theta_o - theta_a) * 180.f / M_PI).vector(a.w));
+    r.cosTheta_o = std::cos(theta_o);
+    return r;
+}
+
+// 一个发光图元的 LightBounds：三角形只朝法线一侧发光，其余物体按各向发光处理
+static LightBounds primBounds(const LightPrim &light)
+{
+    LightBounds lb;
+    const Vector3f &e = light.emit;
+    lb.phi = light.area * (0.2126f * e.x + 0.7152f * e.y + 0.0722f * e.z);
+    lb.cosTheta_e = std::cos(M_PI / 2);
+    if (!light.mesh) {
+        lb.bounds = light.obj->getBounds();
+        lb.w = Vector3f(0, 0, 1);
+        lb.cosTheta_o = -1;
+        return lb;
+    }
+    const TriangleMesh &mesh = *light.mesh;
+    Vector3f v[3];
+    for (int k = 0; k < 3; ++k)
+        v[k] = mesh.positions[mesh.indices[3 * light.triangle + k]];
+    Vector3f n = crossProduct(v[1] - v[0], v[2] - v[0]);
+    if (light.instance) {
+        for (int k = 0; k < 3; ++k)
+            v[k] = light.instance->objectToWorld.point(v[k]);
+        n = light.instance->worldToObject.normal(n);
+    }
+    lb.bounds = Union(Bounds3(v[0], v[1]), v[2]);
+    lb.w = normalize(n);
+    lb.cosTheta_o = 1;
+    return lb;
+}
+
+// 朝向锥的立体角度量 (pbrt-v4 的 M_Omega)，用于划分代价
+static float coneMeasure(const LightBounds &b)
+{
+    float theta_o = safeAcos(b.cosTheta_o), theta_e = safeAcos(b.cosTheta_e);
+    float theta_w = std::min(theta_o + theta_e, (float)M_PI);
+    float sinTheta_o = safeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+    return 2 * M_PI * (1 - b.cosTheta_o) +
+           M_PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+                       2 * theta_o * sinTheta_o + b.cosTheta_o);
+}
+
+LightBVH::LightBVH(const LightDistribution &lights) : lights(lights)
+{
+    std::vector<std::pair<uint32_t, LightBounds>> prims;
+    for (uint32_t i = 0; i < lights.lights.size(); ++i) {
+        LightBounds lb = primBounds(lights.lights[i]);
+        if (lb.phi > 0)
+            prims.push_back({i, lb});
+    }
+    lightTrail.assign(lights.lights.size(), 0);
+    if (!prims.empty())
+        build(prims, 0, prims.size(), 0, 0);
+}
+
+int LightBVH::build(std::vector<std::pair<uint32_t, LightBounds>> &prims, int start, int end,
+                    uint64_t trail, int depth)
+{
+    int index = nodes.size();
+    nodes.emplace_back();
+    if (end - start == 1) {
+        nodes[index] = {prims[start].second, (int)prims[start].first, true};
+        lightTrail[prims[start].first] = trail;
+        return index;
+    }
+
+    Bounds3 bounds, centroidBounds;
+    for (int i = start; i < end; ++i) {
+        const Bounds3 &b = prims[i].second.bounds;
+        bounds = Union(bounds, b);
+        centroidBounds = Union(centroidBounds, 0.5f * b.pMin + 0.5f * b.pMax);
+    }
+
+    // 三个轴各分 12 个桶，代价 = 功率 x 朝向锥度量 x 表面积，Kr 惩罚细长的划分
+    constexpr int nBuckets = 12;
+    float minCost = std::numeric_limits<float>::infinity();
+    int minDim = -1, minBucket = -1;
+    auto bucketOf = [&](const LightBounds &lb, int dim) {
+        Vector3f pc = 0.5f * lb.bounds.pMin + 0.5f * lb.bounds.pMax;
+        int b = nBuckets * centroidBounds.Offset(pc)[dim];
+        return std::min(b, nBuckets - 1);
+    };
+    Vector3f diag = bounds.Diagonal();
+    float maxDiag = std::max(diag.x, std::max(diag.y, diag.z));
+    // trail 每层占一位，叶节点最深只能到第 64 层。对半分还需要 ceil(log2(n)) 层，
+    // 剩下的层数刚好够时不再按代价划分，保证之后全部对半分也不超过 64 层
+    int levels = 0;
+    while ((uint64_t(1) << levels) < uint64_t(end - start))
+        ++levels;
+    bool balanced = depth + levels >= 64;
+    for (int dim = 0; dim < 3; ++dim) {
+        if (!(centroidBounds.pMax[dim] > centroidBounds.pMin[dim]) || balanced)
+            continue;
+        LightBounds buckets[nBuckets];
+        for (int i = start; i < end; ++i) {
+            int b = bucketOf(prims[i].second, dim);
+            buckets[b] = Union(buckets[b], prims[i].second);
+        }
+        float kr = maxDiag / diag[dim];
+        for (int split = 0; split < nBuckets - 1; ++split) {
+            LightBounds below, above;
+            for (int b = 0; b <= split; ++b)
+                below = Union(below, buckets[b]);
+            for (int b = split + 1; b < nBuckets; ++b)
+                above = Union(above, buckets[b]);
+            if (below.phi == 0 || above.phi == 0)
+                continue;
+            float cost = below.phi * coneMeasure(below) * below.bounds.SurfaceArea() +
+                         above.phi * coneMeasure(above) * above.bounds.SurfaceArea();
+            cost *= kr;
+            if (cost < minCost) {
+                minCost = cost;
+                minDim = dim;
+                minBucket = split;
+            }
+        }
+    }
+
+    int mid;
+    if (minDim < 0) {
+        // 质心重合或剩余层数不够，按数量对半分
+        mid = (start + end) / 2;
+    }
+    else {
+        auto pmid = std::partition(prims.begin() + start, prims.begin() + end,
+            [&](const std::pair<uint32_t, LightBounds> &p) { return bucketOf(p.second, minDim) <= minBucket; });
+        mid = pmid - prims.begin();
+        if (mid == start || mid == end)
+            mid = (start + end) / 2;
+    }
+
+    build(prims, start, mid, trail, depth + 1);
+    int second = build(prims, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+    nodes[index].lb = Union(nodes[index + 1].lb, nodes[second].lb);
+    nodes[index].childOrLight = second;
+    nodes[index].leaf = false;
+    return index;
+}
+
+void LightBVH::sample(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf,
+                      Sampler &sampler) const
+{
+    pdf = 0;
+    if (nodes.empty())
+        return;
+    float pmf = 1;
+    int index = 0;
+    while (!nodes[index].leaf) {
+        const LightBVHNode &node = nodes[index];
+        float c0 = nodes[index + 1].lb.importance(p, n);
+        float c1 = nodes[node.childOrLight].lb.importance(p, n);
+        if (c0 == 0 && c1 == 0)
+            return;
+        float p0 = c0 / (c0 + c1);
+        if (sampler.get1D() < p0) {
+            index = index + 1;
+            pmf *= p0;
+        }
+        else {
+            index = node.childOrLight;
+            pmf *= 1 - p0;
+        }
+    }
+    // 只有一个光源时根就是叶节点，同样要检查它能否照到 p
+    if (index == 0 && nodes[0].lb.importance(p, n) == 0)
+        return;
+    lights.samplePrim(nodes[index].childOrLight, pos, pdf, sampler);
+    pdf *= pmf;
+}
+
+float LightBVH::pmf(const Vector3f &p, const Vector3f &n, uint32_t light) const
+{
+    if (nodes.empty() || light >= lightTrail.size())
+        return 0;
+    uint64_t trail = lightTrail[light];
+    float pmf = 1;
+    int index = 0;
+    for (int depth = 0; !nodes[index].leaf; ++depth) {
+        const LightBVHNode &node = nodes[index];
+        float c0 = nodes[index + 1].lb.importance(p, n);
+        float c1 = nodes[node.childOrLight].lb.importance(p, n);
+        if (c0 == 0 && c1 == 0)
+            return 0;
+        bool second = (trail >> depth) & 1;
+        pmf *= (second ? c1 : c0) / (c0 + c1);
+        index = second ? node.childOrLight : index + 1;
+    }
+    if (nodes[index].childOrLight != (int)light)
+        return 0;
+    if (index == 0 && nodes[0].lb.importance(p, n) == 0)
+        return 0;
+    return pmf;
+}
@@ -0,0 +1,58 @@
+//
+// Light BVH: importance-samples emissive primitives per shading point.
+//
+
+#ifndef RAYTRACING_LIGHTBVH_H
+#define RAYTRACING_LIGHTBVH_H
+
+#include <cstdint>
+#include <vector>
+#include "Bounds3.hpp"
+#include "LightDistribution.hpp"
+#include "Vector.hpp"
+
+// 一组光源的包围盒、发光方向锥和功率。
+// 发光方向都在以 w 为轴、半角 theta_o 的锥内，每个方向再向外最多发散 theta_e
+struct LightBounds
+{
+    Bounds3 bounds;
+    Vector3f w;
+    float phi = 0;          // 功率（面积 x 亮度）
+    float cosTheta_o = 1;
+    float cosTheta_e = 1;
+
+    // 对着色点 p（法线 n）贡献的上界估计，p 看不到这组光源时为 0
+    float importance(const Vector3f &p, const Vector3f &n) const;
+};
+
+LightBounds Union(const LightBounds &a, const LightBounds &b);
+
+struct LightBVHNode
+{
+    LightBounds lb;
+    int childOrLight;   // 内部节点：第二个孩子的下标（第一个孩子紧跟其后）；叶节点：光源下标
+    bool leaf;
+};
+
+// 在 LightDistribution 的发光图元上构建。采样时从根往下，按两个孩子对着色点的
+// importance 选择分支，选中概率的乘积就是选中该光源的概率
+class LightBVH
+{
+public:
+    explicit LightBVH(const LightDistribution &lights);
+
+    // 采样 p 点（法线 n）可能看到的光源，pdf 为对面积的概率密度；所有光源都照不到 p 时 pdf 为 0
+    void sample(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 在 p 点选中第 light 个光源的概率，用于 MIS
+    float pmf(const Vector3f &p, const Vector3f &n, uint32_t light) const;
+
+    const LightDistribution &lights;
+    std::vector<LightBVHNode> nodes;
+    std::vector<uint64_t> lightTrail;   // 每个光源从根到叶的路径，第 k 位为第 k 层是否走第二个孩子
+
+private:
+    int build(std::vector<std::pair<uint32_t, LightBounds>> &prims, int start, int end,
+              uint64_t trail, int depth);
+};
+
+#endif //RAYTRACING_LIGHTBVH_H
@@ -0,0 +1,132 @@
+//
+// Precomputed table of emissive primitives for light sampling.
+//
+
+#include "LightDistribution.hpp"
+#include "Instance.hpp"
+
+void AliasTable::build(const std::vector<float> &weights)
+{
+    size_t n = weights.size();
+    prob.assign(n, 1.f);
+    alias.resize(n);
+    pmf.assign(n, 0.f);
+    double total = 0;
+    for (float w : weights)
+        total += w;
+    if (n == 0 || total <= 0)
+        return;
+
+    // 把权重缩放到平均值为 1，小于 1 的格子用一个大于 1 的格子补满
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+        alias[i] = i;
+        pmf[i] = weights[i] / total;
+        scaled[i] = weights[i] / total * n;
+        (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+        prob[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // 剩下的格子只差舍入误差，全部留在本格
+    for (uint32_t i : small)
+        prob[i] = 1;
+    for (uint32_t i : large)
+        prob[i] = 1;
+}
+
+uint32_t AliasTable::sample(float u) const
+{
+    float x = u * prob.size();
+    uint32_t i = std::min((uint32_t)x, (uint32_t)prob.size() - 1);
+    return x - i < prob[i] ? i : alias[i];
+}
+
+LightDistribution::LightDistribution(const std::vector<Object*> &objects)
+{
+    for (Object* obj : objects) {
+        if (!obj->hasEmit())
+            continue;
+
+        // 网格和网格实例逐个三角形加入，其它物体整体加入
+        const Instance* instance = dynamic_cast<const Instance*>(obj);
+        const BVHAccel* accel = instance ? instance->accel : obj->getAccel();
+        const TriangleMesh* mesh = accel ? accel->mesh : nullptr;
+        firstLight[obj] = lights.size();
+        if (!mesh) {
+            // Object 不直接暴露材质，采样一次取得它的发光
+            Intersection pos;
+            float pdf;
+            Sampler sampler(0, 0);
+            obj->Sample(pos, pdf, sampler);
+            lights.push_back({obj, nullptr, nullptr, 0, obj->getArea(), pos.emit});
+            continue;
+        }
+
+        Material* m = instance && instance->m ? instance->m : mesh->m;
+        for (uint32_t i = 0; i < mesh->size(); ++i) {
+            float area = mesh->getArea(i);
+            if (instance) {
+                Vector3f v0, e1, e2;
+                mesh->getVertices(i, v0, e1, e2);
+                area = crossProduct(instance->objectToWorld.vector(e1),
+                                    instance->objectToWorld.vector(e2)).norm() * 0.5f;
+            }
+            // 面积为 0 的三角形也占一个位置，保证下标等于 firstLight + 三角形编号；它的权重为 0，不会被采样
+            lights.push_back({obj, mesh, instance, i, area, m->getEmission()});
+        }
+    }
+
+    // 权重取 面积 x 亮度，正比于光源的功率
+    std::vector<float> weights(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const Vector3f &e = lights[i].emit;
+        weights[i] = lights[i].area * (0.2126f * e.x + 0.7152f * e.y + 0.0722f * e.z);
+    }
+    table.build(weights);
+}
+
+void LightDistribution::samplePrim(size_t i, Intersection &pos, float &pdf, Sampler &sampler) const
+{
+    const LightPrim &light = lights[i];
+    if (!light.mesh) {
+        light.obj->Sample(pos, pdf, sampler);
+        return;
+    }
+    light.mesh->sample(light.triangle, pos, pdf, sampler);
+    if (light.instance) {
+        pos.coords = light.instance->objectToWorld.point(pos.coords);
+        pos.normal = normalize(light.instance->worldToObject.normal(pos.normal));
+    }
+    pos.emit = light.emit;
+    pos.obj = light.obj;
+    pdf = pdfPrim(i);
+}
+
+int LightDistribution::lightIndex(const Intersection &isect) const
+{
+    auto it = firstLight.find(isect.obj);
+    if (it == firstLight.end())
+        return -1;
+    return lights[it->second].mesh ? it->second + isect.primIndex : it->second;
+}
+
+void LightDistribution::sample(Intersection &pos, float &pdf, Sampler &sampler) const
+{
+    if (lights.empty()) {
+        pdf = 0;
+        return;
+    }
+    uint32_t i = table.sample(sampler.get1D());
+    samplePrim(i, pos, pdf, sampler);
+    pdf *= table.pmf[i];
+}
@@ -0,0 +1,63 @@
+//
+// Precomputed table of emissive primitives for light sampling.
+//
+
+#ifndef RAYTRACING_LIGHTDISTRIBUTION_H
+#define RAYTRACING_LIGHTDISTRIBUTION_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Object.hpp"
+#include "TriangleMesh.hpp"
+
+class Instance;
+
+// Walker/Vose 别名表：O(1) 按权重抽取下标
+struct AliasTable
+{
+    std::vector<float> prob;       // 留在本格的概率
+    std::vector<uint32_t> alias;   // 否则取的下标
+    std::vector<float> pmf;        // 归一化后的权重
+
+    void build(const std::vector<float> &weights);
+    // u 取 [0, 1)，用同一个随机数选格子和决定是否取别名
+    uint32_t sample(float u) const;
+    size_t size() const { return prob.size(); }
+};
+
+// 一个发光图元：网格光源拆成单个三角形，其它物体整体作为一个光源
+struct LightPrim
+{
+    Object* obj;                        // 交点记录的物体
+    const TriangleMesh* mesh;           // 三角形所在网格，为空时对 obj 整体采样
+    const Instance* instance;           // 网格属于实例时，三角形在物体空间
+    uint32_t triangle;
+    float area;                         // 世界空间面积
+    Vector3f emit;
+};
+
+// 构建一次，之后每次采样 O(1)：按 面积 x 亮度 选一个发光图元，再在图元上均匀采样
+class LightDistribution
+{
+public:
+    explicit LightDistribution(const std::vector<Object*> &objects);
+
+    // pos 为光源上的采样点，pdf 为对面积的概率密度（已含选中该图元的概率）
+    void sample(Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 在第 i 个发光图元上均匀采样，pdf 为 1 / 面积
+    void samplePrim(size_t i, Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 交点 isect 所在发光图元的下标，isect 不在光源上时返回 -1
+    int lightIndex(const Intersection &isect) const;
+    // 在第 i 个发光图元上采样时对面积的概率密度 1 / 面积
+    float pdfPrim(size_t i) const { return lights[i].area > 0 ? 1.0f / lights[i].area : 0.0f; }
+
+    bool empty() const { return lights.empty(); }
+
+    std::vector<LightPrim> lights;
+    AliasTable table;
+    // 每个发光物体的第一个发光图元；网格的三角形按编号连续存放
+    std::unordered_map<const Object*, uint32_t> firstLight;
+};
+
+#endif //RAYTRACING_LIGHTDISTRIBUTION_H
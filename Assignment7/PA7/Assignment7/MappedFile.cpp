@@ -0,0 +1,71 @@
+//
+// Read-only memory mapping of a whole file.
+//
+
+#include "MappedFile.hpp"
+
+#if defined(_WIN32)
+#include <cstdio>
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+// 没有 mmap 时整个读进按页对齐的内存，调用方看到的布局相同
+bool MappedFile::open(const std::string &path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buffer = size > 0 ? static_cast<char*>(_aligned_malloc(size, 4096)) : nullptr;
+    bool ok = buffer && fread(buffer, 1, size, fp) == (size_t)size;
+    fclose(fp);
+    if (!ok) {
+        _aligned_free(buffer);
+        return false;
+    }
+    base = buffer;
+    length = size;
+    return true;
+}
+
+MappedFile::~MappedFile()
+{
+    _aligned_free(const_cast<char*>(base));
+}
+
+#else
+
+bool MappedFile::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后就不再需要文件描述符
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    base = static_cast<const char*>(p);
+    length = st.st_size;
+    return true;
+}
+
+MappedFile::~MappedFile()
+{
+    if (base)
+        munmap(const_cast<char*>(base), length);
+}
+
+#endif
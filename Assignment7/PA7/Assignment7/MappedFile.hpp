@@ -0,0 +1,33 @@
+//
+// Read-only memory mapping of a whole file.
+//
+
+#ifndef RAYTRACING_MAPPEDFILE_H
+#define RAYTRACING_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// 只读映射整个文件，析构时解除映射。映射的起始地址按页对齐，
+// 文件里按 64 字节对齐存放的数组可以直接当作对应类型的数组使用
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 失败（文件不存在、为空或无法映射）时返回 false
+    bool open(const std::string &path);
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+};
+
+#endif //RAYTRACING_MAPPEDFILE_H
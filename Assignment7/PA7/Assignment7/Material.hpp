@@ -6,6 +6,7 @@
 #define RAYTRACING_MATERIAL_H
 
 #include "Vector.hpp"
+#include "Sampler.hpp"
 
 enum MaterialType { DIFFUSE, Microfacet};
 
@@ -71,8 +72,7 @@ private:
         // kt = 1 - kr;
     }
 
-    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
-        Vector3f B, C;
+    void coordinateSystem(const Vector3f &N, Vector3f &B, Vector3f &C){
         if (std::fabs(N.x) > std::fabs(N.y)){
             float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
             C = Vector3f(N.z * invLen, 0.0f, -N.x *invLen);
@@ -82,14 +82,71 @@ private:
             C = Vector3f(0.0f, N.z * invLen, -N.y *invLen);
         }
         B = crossProduct(C, N);
+    }
+
+    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
+        Vector3f B, C;
+        coordinateSystem(N, B, C);
         return a.x * B + a.y * C + a.z * N;
     }
 
+    Vector3f toLocal(const Vector3f &a, const Vector3f &N){
+        Vector3f B, C;
+        coordinateSystem(N, B, C);
+        return Vector3f(dotProduct(a, B), dotProduct(a, C), dotProduct(a, N));
+    }
+
+    // 余弦加权采样半球，pdf = cos / PI
+    Vector3f sampleCosine(Sampler &sampler){
+        float x_1 = sampler.get1D(), x_2 = sampler.get1D();
+        float r = std::sqrt(x_1), phi = 2 * M_PI * x_2;
+        return Vector3f(r*std::cos(phi), r*std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - x_1)));
+    }
+
+    // GGX 可见法线采样 (Heitz 2018)，V 为局部坐标下的出射方向，返回局部坐标下的微表面法线
+    Vector3f sampleGGXVNDF(const Vector3f &V, float alpha, Sampler &sampler){
+        Vector3f Vh = normalize(Vector3f(alpha * V.x, alpha * V.y, V.z));
+        float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+        Vector3f T1 = lensq > 0 ? Vector3f(-Vh.y, Vh.x, 0) / std::sqrt(lensq) : Vector3f(1, 0, 0);
+        Vector3f T2 = crossProduct(Vh, T1);
+        float x_1 = sampler.get1D(), x_2 = sampler.get1D();
+        float r = std::sqrt(x_1), phi = 2 * M_PI * x_2;
+        float t1 = r * std::cos(phi), t2 = r * std::sin(phi);
+        float s = 0.5f * (1.0f + Vh.z);
+        t2 = (1.0f - s) * std::sqrt(std::max(0.0f, 1.0f - t1 * t1)) + s * t2;
+        Vector3f Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1.0f - t1 * t1 - t2 * t2)) * Vh;
+        return normalize(Vector3f(alpha * Nh.x, alpha * Nh.y, std::max(0.0f, Nh.z)));
+    }
+
+    // 可见法线采样得到反射方向 L 的 pdf：D(H) G1(V) / (4 N.V)，G1 为 GGX 的 Smith 遮蔽项
+    float pdfGGXVNDF(const Vector3f &N, const Vector3f &V, const Vector3f &L, float roughness){
+        float NdotV = dotProduct(N, V);
+        if (NdotV <= 0.0f)
+            return 0.0f;
+        float a2 = roughness * roughness * roughness * roughness;
+        float D = DistributionGGX(N, normalize(V + L), roughness);
+        return D / (2.0f * (NdotV + std::sqrt(a2 + (1.0f - a2) * NdotV * NdotV)));
+    }
+
+    // Microfacet 按 镜面 / 漫反射 两个分量的估计反射率选择采样哪一支，镜面至少占 1/4
+    float specularProbability(const Vector3f &wi, const Vector3f &N){
+        if (dotProduct(-wi, N) <= 0.0f)
+            return 0.0f;
+        float F;
+        fresnel(wi, N, ior, F);
+        float spec = F * (Ks.x + Ks.y + Ks.z);
+        float diff = (1.0f - F) * (Kd.x + Kd.y + Kd.z);
+        if (spec + diff <= 0.0f)
+            return 0.5f;
+        return std::max(spec / (spec + diff), 0.25f);
+    }
+
 public:
     MaterialType m_type;
     //Vector3f m_color;
     Vector3f m_emission;
-    float ior;
+    // 折射率，Microfacet 的菲涅尔项用它，eval 与 specularProbability 共用
+    float ior = 1.85f;
     Vector3f Kd, Ks;
     float specularExponent;
     //Texture tex;
@@ -100,14 +157,28 @@ public:
     inline Vector3f getColorAt(double u, double v);
     inline Vector3f getEmission();
     inline bool hasEmission();
+    // 反照率的粗略估计，只用于去噪的特征缓冲
+    inline Vector3f getAlbedo();
+
+    // 微表面粗糙度，eval 与 sample/pdf 共用
+    float roughness = 0.35f;
 
     // sample a ray by Material properties
-    inline Vector3f sample(const Vector3f &wi, const Vector3f &N);
+    inline Vector3f sample(const Vector3f &wi, const Vector3f &N, Sampler &sampler);
     // given a ray, calculate the PdF of this ray
     inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
     // given a ray, calculate the contribution of this ray
     inline Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
 
+    // 单一材质类型的 BSDF，上面三个函数按 m_type 分派到这里。
+    // 已经按材质分好组的调用者（波前积分器的着色队列）直接调用，不经过 switch
+    inline Vector3f sampleDiffuse(const Vector3f &N, Sampler &sampler);
+    inline float pdfDiffuse(const Vector3f &wo, const Vector3f &N);
+    inline Vector3f evalDiffuse(const Vector3f &wo, const Vector3f &N);
+    inline Vector3f sampleMicrofacet(const Vector3f &wi, const Vector3f &N, Sampler &sampler);
+    inline float pdfMicrofacet(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
+    inline Vector3f evalMicrofacet(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
+
     float DistributionGGX(Vector3f N, Vector3f H, float roughness)
     {
         float a = roughness * roughness;
@@ -159,115 +230,125 @@ bool Material::hasEmission() {
     else return false;
 }
 
+Vector3f Material::getAlbedo() {
+    if (hasEmission())
+        return Vector3f(1.0f);
+    if (m_type == Microfacet)
+        return Vector3f(std::min(Kd.x + Ks.x, 1.0f), std::min(Kd.y + Ks.y, 1.0f), std::min(Kd.z + Ks.z, 1.0f));
+    return Kd;
+}
+
 Vector3f Material::getColorAt(double u, double v) {
     return Vector3f();
 }
 
 
-Vector3f Material::sample(const Vector3f &wi, const Vector3f &N){
+Vector3f Material::sample(const Vector3f &wi, const Vector3f &N, Sampler &sampler){
     switch(m_type){
         case DIFFUSE:
-        {
-            // uniform sample on the hemisphere
-            float x_1 = get_random_float(), x_2 = get_random_float();
-            float z = std::fabs(1.0f - 2.0f * x_1);
-            float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
-            Vector3f localRay(r*std::cos(phi), r*std::sin(phi), z);
-            return toWorld(localRay, N);
-            
-            break;
-        }
+            return sampleDiffuse(N, sampler);
         case Microfacet:
-        {
-            // uniform sample on the hemisphere
-            float x_1 = get_random_float(), x_2 = get_random_float();
-            float z = std::fabs(1.0f - 2.0f * x_1);
-            float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
-            Vector3f localRay(r*std::cos(phi), r*std::sin(phi), z);
-            return toWorld(localRay, N);
-
-            break;
-        }
+            return sampleMicrofacet(wi, N, sampler);
     }
 }
 
 float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
     switch(m_type){
         case DIFFUSE:
-        {
-            // uniform sample probability 1 / (2 * PI)
-            if (dotProduct(wo, N) > 0.0f)
-                return 0.5f / M_PI;
-            else
-                return 0.0f;
-            break;
-        }
+            return pdfDiffuse(wo, N);
         case Microfacet:
-        {
-            // uniform sample probability 1 / (2 * PI)
-            if (dotProduct(wo, N) > 0.0f)
-                return 0.5f / M_PI;
-            else
-                return 0.0f;
-            break;
-        }
+            return pdfMicrofacet(wi, wo, N);
     }
 }
 
 Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
     switch(m_type){
         case DIFFUSE:
-        {
-            // calculate the contribution of diffuse   model
-            float cosalpha = dotProduct(N, wo);
-            if (cosalpha > 0.0f) {
-                Vector3f diffuse = Kd / M_PI;
-                return diffuse;
-            }
-            else
-                return Vector3f(0.0f);
-            break;
-        }
+            return evalDiffuse(wo, N);
         case Microfacet:
-        {
-            // Disney PBR
-            float cosalpha = dotProduct(N, wo);
-            if(cosalpha > 0.0f){
-                float roughness = 0.35f;
-
-                Vector3f V = -wi;
-                Vector3f L = wo;
-                Vector3f H = normalize(V + L);
-
-                // compute distribution of normals: D
-                float D = DistributionGGX(N, H, roughness);
-
-                //compute shadowing masking term: G
-                float G = GeometrySmith(N, V, L, roughness);
-
-                //compute fresnel coefficient: F
-                float F;
-                float etat = 1.85;
-                fresnel(wi, N, etat, F);
-
-                Vector3f nominator = D * G * F;
-                float denominator = 4 * std::max(dotProduct(N, V), 0.0f) * std::max(dotProduct(N, L), 0.0f);
-                Vector3f specular = nominator / std::max(denominator, 0.001f);
-
-                // 能量守恒
-                float ks_ = F;
-                float kd_ = 1.0f - ks_;
-
-                Vector3f diffuse = 1.0f / M_PI;
-
-                return Ks * specular + kd_ * Kd * diffuse;
-            }
-            else
-            {
-                return Vector3f(0.0f);
-            }
-            break;
-        }
+            return evalMicrofacet(wi, wo, N);
+    }
+}
+
+Vector3f Material::sampleDiffuse(const Vector3f &N, Sampler &sampler){
+    // cosine-weighted sample on the hemisphere
+    return toWorld(sampleCosine(sampler), N);
+}
+
+float Material::pdfDiffuse(const Vector3f &wo, const Vector3f &N){
+    // cosine sample probability cos / PI
+    float cosalpha = dotProduct(wo, N);
+    if (cosalpha > 0.0f)
+        return cosalpha / M_PI;
+    else
+        return 0.0f;
+}
+
+Vector3f Material::evalDiffuse(const Vector3f &wo, const Vector3f &N){
+    // calculate the contribution of diffuse   model
+    float cosalpha = dotProduct(N, wo);
+    if (cosalpha > 0.0f) {
+        Vector3f diffuse = Kd / M_PI;
+        return diffuse;
+    }
+    else
+        return Vector3f(0.0f);
+}
+
+Vector3f Material::sampleMicrofacet(const Vector3f &wi, const Vector3f &N, Sampler &sampler){
+    // 按概率选择 GGX 可见法线采样或余弦采样，pdf 为两者的混合
+    if (sampler.get1D() < specularProbability(wi, N)) {
+        Vector3f V = toLocal(-wi, N);
+        Vector3f H = sampleGGXVNDF(V, roughness * roughness, sampler);
+        Vector3f L = 2.0f * dotProduct(V, H) * H - V;
+        return toWorld(L, N);
+    }
+    return toWorld(sampleCosine(sampler), N);
+}
+
+float Material::pdfMicrofacet(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+    float cosalpha = dotProduct(wo, N);
+    if (cosalpha > 0.0f) {
+        float p = specularProbability(wi, N);
+        return p * pdfGGXVNDF(N, -wi, wo, roughness) + (1.0f - p) * cosalpha / M_PI;
+    }
+    else
+        return 0.0f;
+}
+
+Vector3f Material::evalMicrofacet(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+    // Disney PBR
+    float cosalpha = dotProduct(N, wo);
+    if(cosalpha > 0.0f){
+        Vector3f V = -wi;
+        Vector3f L = wo;
+        Vector3f H = normalize(V + L);
+
+        // compute distribution of normals: D
+        float D = DistributionGGX(N, H, roughness);
+
+        //compute shadowing masking term: G
+        float G = GeometrySmith(N, V, L, roughness);
+
+        //compute fresnel coefficient: F
+        float F;
+        fresnel(wi, N, ior, F);
+
+        Vector3f nominator = D * G * F;
+        float denominator = 4 * std::max(dotProduct(N, V), 0.0f) * std::max(dotProduct(N, L), 0.0f);
+        Vector3f specular = nominator / std::max(denominator, 0.001f);
+
+        // 能量守恒
+        float ks_ = F;
+        float kd_ = 1.0f - ks_;
+
+        Vector3f diffuse = 1.0f / M_PI;
+
+        return Ks * specular + kd_ * Kd * diffuse;
+    }
+    else
+    {
+        return Vector3f(0.0f);
     }
 }
 
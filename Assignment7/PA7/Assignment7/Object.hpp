@@ -10,21 +10,41 @@
 #include "Bounds3.hpp"
 #include "Ray.hpp"
 #include "Intersection.hpp"
+#include "Sampler.hpp"
+#include "RayPacket.hpp"
+
+class BVHAccel;
 
 class Object
 {
 public:
     Object() {}
     virtual ~Object() {}
+    // 遮挡测试：[0, ray.t_max] 内有任意交点即返回 true
     virtual bool intersect(const Ray& ray) = 0;
     virtual bool intersect(const Ray& ray, float &, uint32_t &) const = 0;
     virtual Intersection getIntersection(Ray _ray) = 0;
+    // 光线包求交：mask 中每条光线有更近的交点时更新 hits[i] 和 packet.tMax[i]
+    virtual void intersectPacket(RayPacket &packet, uint32_t mask, Intersection *hits)
+    {
+        for (int i = 0; i < RayPacket::Size; ++i) {
+            if (!(mask & (1u << i)))
+                continue;
+            Intersection hit = getIntersection(packet.ray(i));
+            if (hit.happened && hit.distance < hits[i].distance) {
+                hits[i] = hit;
+                packet.tMax[i] = hit.distance;
+            }
+        }
+    }
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const =0;
     virtual Bounds3 getBounds()=0;
     virtual float getArea()=0;
-    virtual void Sample(Intersection &pos, float &pdf)=0;
+    virtual void Sample(Intersection &pos, float &pdf, Sampler &sampler)=0;
     virtual bool hasEmit()=0;
+    // 自带 BVH 的物体（三角形网格）返回它，上层 BVH 的叶节点直接下降，不经过虚函数求交
+    virtual const BVHAccel* getAccel() const { return nullptr; }
 };
 
 
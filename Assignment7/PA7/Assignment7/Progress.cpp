@@ -0,0 +1,105 @@
+//
+// Render progress: per-worker counters sampled by a single reporter thread.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include "Progress.hpp"
+
+ProgressReporter::ProgressReporter(int workers, uint64_t total, uint64_t done)
+    : numSlots(workers), slots(new Slot[workers]), total(total), initial(done)
+{
+}
+
+ProgressReporter::~ProgressReporter()
+{
+    if (reporter.joinable())
+        stop();
+}
+
+uint64_t ProgressReporter::samples() const
+{
+    uint64_t done = initial;
+    for (int i = 0; i < numSlots; ++i)
+        done += slots[i].samples.load(std::memory_order_relaxed);
+    return done;
+}
+
+uint64_t ProgressReporter::rays() const
+{
+    uint64_t n = 0;
+    for (int i = 0; i < numSlots; ++i)
+        n += slots[i].rays.load(std::memory_order_relaxed);
+    return n;
+}
+
+void ProgressReporter::start()
+{
+    startTime = std::chrono::steady_clock::now();
+    stopping = false;
+    reporter = std::thread(&ProgressReporter::run, this);
+}
+
+void ProgressReporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopCv.notify_one();
+    reporter.join();
+
+    // 最终状态显示整个渲染的平均光线速度
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    draw(samples(), elapsed > 0 ? rays() / elapsed : 0.0, elapsed, true);
+}
+
+void ProgressReporter::run()
+{
+    auto last = startTime;
+    uint64_t lastRays = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopCv.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return stopping; })) {
+        // 光线速度取最近一个间隔内的增量
+        auto now = std::chrono::steady_clock::now();
+        uint64_t n = rays();
+        double dt = std::chrono::duration<double>(now - last).count();
+        draw(samples(), dt > 0 ? (n - lastRays) / dt : 0.0,
+             std::chrono::duration<double>(now - startTime).count(), false);
+        last = now;
+        lastRays = n;
+    }
+}
+
+void ProgressReporter::draw(uint64_t done, double raysPerSecond, double elapsed, bool final) const
+{
+    const int barWidth = 70;
+    float progress = total ? std::min(1.0, (double)done / total) : 1.0f;
+    if (final)
+        progress = 1.0f;
+
+    char bar[barWidth + 1];
+    int pos = barWidth * progress;
+    for (int i = 0; i < barWidth; ++i)
+        bar[i] = i < pos ? '=' : (i == pos ? '>' : ' ');
+    bar[barWidth] = 0;
+
+    // 剩余时间按本次运行的平均速度估计，从断点恢复的样本不计入速度
+    char eta[32] = "--:--";
+    uint64_t doneHere = done - initial;
+    if (final) {
+        snprintf(eta, sizeof(eta), "%d:%02d", (int)elapsed / 60, (int)elapsed % 60);
+    }
+    else if (doneHere > 0 && done < total) {
+        int seconds = (int)(elapsed * (total - done) / doneHere);
+        if (seconds >= 3600)
+            snprintf(eta, sizeof(eta), "%d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+        else
+            snprintf(eta, sizeof(eta), "%d:%02d", seconds / 60, seconds % 60);
+    }
+
+    // 行尾补空格，覆盖上一次较长的输出
+    printf("[%s] %d %% %s %-8s %7.2f Mrays/s   \r", bar, int(progress * 100.0), final ? "took" : "ETA", eta,
+           raysPerSecond * 1e-6);
+    fflush(stdout);
+}
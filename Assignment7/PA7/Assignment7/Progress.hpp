@@ -0,0 +1,69 @@
+//
+// Render progress: per-worker counters sampled by a single reporter thread.
+//
+
+#ifndef RAYTRACING_PROGRESS_H
+#define RAYTRACING_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// 渲染进度。每个 worker 只写自己的计数器（relaxed 原子量，各占一条缓存行），
+// 后台线程按固定间隔读取并打印进度条、剩余时间和当前的光线速度，worker 从不等待控制台输出
+class ProgressReporter
+{
+public:
+    // total 为总样本数，done 为开始前已经完成的样本数（从断点恢复时非零）
+    ProgressReporter(int workers, uint64_t total, uint64_t done = 0);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    // worker 线程调用，累加该 worker 完成的样本数和追踪的光线数。
+    // 每个计数器只有一个写者，用 load + store 代替 fetch_add，不需要加锁的读改写指令
+    void add(int worker, uint64_t samples, uint64_t rays)
+    {
+        Slot &s = slots[worker];
+        s.samples.store(s.samples.load(std::memory_order_relaxed) + samples, std::memory_order_relaxed);
+        s.rays.store(s.rays.load(std::memory_order_relaxed) + rays, std::memory_order_relaxed);
+    }
+
+    // 目前完成的样本数（含开始前已完成的）
+    uint64_t samples() const;
+
+    // 启动/停止后台打印线程，stop 会再打印一次最终状态
+    void start();
+    void stop();
+
+    // 打印间隔（毫秒）
+    int intervalMs = 250;
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> rays{0};
+    };
+
+    uint64_t rays() const;
+    void run();
+    void draw(uint64_t done, double raysPerSecond, double elapsed, bool final) const;
+
+    int numSlots;
+    std::unique_ptr<Slot[]> slots;
+    uint64_t total, initial;
+    std::chrono::steady_clock::time_point startTime;
+
+    std::thread reporter;
+    std::mutex mutex;
+    std::condition_variable stopCv;
+    bool stopping = false;
+};
+
+#endif //RAYTRACING_PROGRESS_H
@@ -10,7 +10,7 @@ struct Ray{
     Vector3f origin;
     Vector3f direction, direction_inv;
     double t;//transportation time,
-    double t_min, t_max;
+    double t_min, t_max;//有效区间，求交时超过 t_max 的交点被忽略
 
     Ray(const Vector3f& ori, const Vector3f& dir, const double _t = 0.0): origin(ori), direction(dir),t(_t) {
         direction_inv = Vector3f(1./direction.x, 1./direction.y, 1./direction.z);
@@ -0,0 +1,57 @@
+//
+// SoA bundle of coherent rays traced through the BVH together.
+//
+
+#ifndef RAYTRACING_RAYPACKET_H
+#define RAYTRACING_RAYPACKET_H
+
+#include <array>
+#include <cstdint>
+#include "Ray.hpp"
+#include "Vector.hpp"
+
+// 一个 4x4 像素块的主光线；lane i 是否参与由调用方的 mask 第 i 位决定
+struct alignas(32) RayPacket
+{
+    static constexpr int Size = 16;
+
+    float ox[Size], oy[Size], oz[Size];
+    float dx[Size], dy[Size], dz[Size];
+    float ix[Size], iy[Size], iz[Size];   // 方向的倒数
+    float tMax[Size];                     // 每条光线当前最近交点距离
+
+    void set(int i, const Ray &ray)
+    {
+        ox[i] = ray.origin.x; oy[i] = ray.origin.y; oz[i] = ray.origin.z;
+        dx[i] = ray.direction.x; dy[i] = ray.direction.y; dz[i] = ray.direction.z;
+        ix[i] = ray.direction_inv.x; iy[i] = ray.direction_inv.y; iz[i] = ray.direction_inv.z;
+        tMax[i] = ray.t_max;
+    }
+
+    Ray ray(int i) const
+    {
+        Ray r(Vector3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i]));
+        r.t_max = tMax[i];
+        return r;
+    }
+
+    // mask 内所有光线方向符号一致时才能共用同一遍历顺序
+    bool coherent(uint32_t mask, std::array<int, 3> &dirIsNeg) const
+    {
+        int first = -1;
+        for (int i = 0; i < Size; ++i) {
+            if (!(mask & (1u << i)))
+                continue;
+            std::array<int, 3> neg{int(ix[i] < 0), int(iy[i] < 0), int(iz[i] < 0)};
+            if (first < 0) {
+                first = i;
+                dirIsNeg = neg;
+            }
+            else if (neg != dirIsNeg)
+                return false;
+        }
+        return first >= 0;
+    }
+};
+
+#endif //RAYTRACING_RAYPACKET_H
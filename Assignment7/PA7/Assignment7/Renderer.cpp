@@ -5,11 +5,15 @@
 #include <fstream>
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "Film.hpp"
 #include <thread>
 #include <mutex>
 #include <atomic>
-
-std::mutex mutex_ins;
+#include <chrono>
+#include "ThreadPool.hpp"
+#include "Wavefront.hpp"
+#include "Stats.hpp"
+#include "Progress.hpp"
 
 inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
 
@@ -20,93 +24,236 @@ const float EPSILON = 0.00001;
 // framebuffer is saved to a file.
 void Renderer::Render(const Scene& scene)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    Film film(scene.width, scene.height);
 
     float scale = tan(deg2rad(scene.fov * 0.5));
     float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(278, 273, -800);
-    int m = 0;
+    Vector3f eye_pos = scene.eyePos;
 
 	// 射线数量
-	int spp = 256;
 	std::cout << "SPP: " << spp << "\n";
 
-	int process = 0;
+	if (resume) {
+		if (film.loadCheckpoint(checkpointPath))
+			std::cout << "Resumed from " << checkpointPath << " (" << film.minCount() << " spp done)\n";
+		else
+			std::cout << "Cannot resume from " << checkpointPath << ", starting from scratch\n";
+	}
+
+	uint64_t totalSamples = (uint64_t)scene.width * scene.height * spp;
+	ThreadPool& pool = ThreadPool::global();
+	std::cout << "Threads: " << pool.size() << "\n";
+	ProgressReporter progress(pool.size(), totalSamples, film.totalSamples());
+
+	// 把画面切成 tileSize x tileSize 的小块，交给线程池动态分配
+	int tilesX = (scene.width + tileSize - 1) / tileSize;
+	int tilesY = (scene.height + tileSize - 1) / tileSize;
+	int passTarget = spp;
+	// 自适应模式下已经收敛的像素，每个像素只属于一个 tile，不需要同步
+	std::vector<char> converged(adaptive ? scene.width * scene.height : 0, 0);
+
+	// 波前模式下每个 worker 一个积分器，批缓冲在各轮之间复用
+	std::vector<std::unique_ptr<WavefrontIntegrator>> integrators;
+	if (wavefront)
+		for (int w = 0; w < pool.size(); ++w)
+			integrators.emplace_back(new WavefrontIntegrator(scene));
+
+	// 追踪积累的整批路径，再按加入顺序把结果写入 film
+	auto flushBatch = [&](WavefrontIntegrator &batch) {
+		batch.run();
+		for (size_t p = 0; p < batch.size(); ++p)
+			film.addSample(batch.pixel[p], batch.radiance(p));
+		batch.clear();
+	};
 
-	// 创造匿名函数，为不同线程划分不同块
-	auto castRayMultiThreading = [&](uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd)
+	// 像素 (i, j) 中心的主光线方向
+	auto primaryDir = [&](int i, int j) {
+		float x = (2 * (i + 0.5) / (float)scene.width - 1) *
+			imageAspectRatio * scale;
+		float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
+		return normalize(Vector3f(-x, y, 1));
+	};
+
+	auto castRayTile = [&](int tile, int worker)
 	{
-		for (uint32_t j = rowStart; j < rowEnd; ++j) {
-			int m = j * scene.width + colStart;
-			for (uint32_t i = colStart; i < colEnd; ++i) {
-				// generate primary ray direction
-				float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-					imageAspectRatio * scale;
-				float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-				Vector3f dir = normalize(Vector3f(-x, y, 1));
-				for (int k = 0; k < spp; k++) {
-					framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;
+		int rowStart = (tile / tilesX) * tileSize;
+		int colStart = (tile % tilesX) * tileSize;
+		int rowEnd = std::min(rowStart + tileSize, scene.height);
+		int colEnd = std::min(colStart + tileSize, scene.width);
+		// 样本数和光线数按行或 4x4 块累计后交给进度计数，不加锁也不打印
+		uint64_t samples = 0;
+		uint64_t raysBefore = Scene::raysTraced();
+		auto reportProgress = [&]() {
+			uint64_t rays = Scene::raysTraced();
+			progress.add(worker, samples, rays - raysBefore);
+			raysBefore = rays;
+			samples = 0;
+		};
+		// 自适应采样：达到最少样本数且误差低于阈值的像素不再追加样本。
+		// 之后不会再有新样本，第一次跳过时就把剩下的样本记为完成，进度才能走到 100 %
+		auto skipPixel = [&](int m, int first) {
+			if (!adaptive || first < minSpp || !(film.relativeError(m) < targetNoise))
+				return false;
+			if (!converged[m]) {
+				converged[m] = 1;
+				samples += std::max(0, spp - first);
+			}
+			return true;
+		};
+
+		if (wavefront) {
+			// tile 内所有像素本轮的样本作为路径加入批次，攒够 wavefrontBatch 条就追踪一次
+			WavefrontIntegrator &batch = *integrators[worker];
+			for (int j = rowStart; j < rowEnd; ++j) {
+				for (int i = colStart; i < colEnd; ++i) {
+					int m = j * scene.width + i;
+					Vector3f dir = primaryDir(i, j);
+					int first = film.count[m];
+					int last = std::min(passTarget, spp);
+					if (skipPixel(m, first))
+						last = first;
+					for (int k = first; k < last; k++) {
+						batch.addPath(eye_pos, dir, m, k);
+						if ((int)batch.size() >= wavefrontBatch)
+							flushBatch(batch);
+					}
+					samples += std::max(0, last - first);
 				}
-				m++;
-				process++;
+				reportProgress();
 			}
+			flushBatch(batch);
+			reportProgress();
+		}
+
+		else {
+			// 以 4x4 像素块为单位：块内主光线打包一起求交，交点在本轮的所有样本间复用
+			// （主光线穿过像素中心，没有抖动，每个样本的主光线都相同）
+			for (int by = rowStart; by < rowEnd; by += 4) {
+				for (int bx = colStart; bx < colEnd; bx += 4) {
+					RayPacket packet;
+					Intersection hits[RayPacket::Size];
+					Vector3f dirs[RayPacket::Size];
+					int pixel[RayPacket::Size], first[RayPacket::Size], last[RayPacket::Size];
+					uint32_t mask = 0;
 
-			// 互斥锁，用于打印处理进程
-			std::lock_guard<std::mutex> g1(mutex_ins);
-			UpdateProgress(1.0*process / scene.width / scene.height);
+					for (int lane = 0; lane < RayPacket::Size; ++lane) {
+						int i = bx + lane % 4, j = by + lane / 4;
+						if (i >= colEnd || j >= rowEnd)
+							continue;
+						int m = j * scene.width + i;
+						// generate primary ray direction
+						Vector3f dir = primaryDir(i, j);
+						pixel[lane] = m;
+						first[lane] = film.count[m];
+						last[lane] = std::min(passTarget, spp);
+						if (skipPixel(m, first[lane]))
+							last[lane] = first[lane];
+						if (last[lane] <= first[lane])
+							continue;
+						dirs[lane] = dir;
+						packet.set(lane, Ray(eye_pos, dir));
+						mask |= 1u << lane;
+					}
+					if (!mask)
+						continue;
+
+					if (primaryPackets)
+						scene.intersectPacket(packet, mask, hits);
+					for (int lane = 0; lane < RayPacket::Size; ++lane) {
+						if (!(mask & (1u << lane)))
+							continue;
+						Ray ray(eye_pos, dirs[lane]);
+						if (!primaryPackets)
+							hits[lane] = scene.intersect(ray);
+						STAT_ADD(primaryRays, 1);
+						int m = pixel[lane];
+						for (int k = first[lane]; k < last[lane]; k++) {
+							// 随机数只依赖像素和样本序号，与线程划分无关
+							Sampler sampler(m, k);
+							film.addSample(m, scene.castRay(ray, hits[lane], 0, sampler));
+						}
+						samples += last[lane] - first[lane];
+					}
+					reportProgress();
+				}
+			}
 		}
 	};
 
-	int id = 0;
-	constexpr int bx = 5;
-	constexpr int by = 5;
-	std::thread th[bx * by];
+	// 每一轮把像素样本数补到 passTarget，渐进模式下 passTarget 逐轮翻倍 (1, 2, 4, ...)，
+	// 自适应模式从 minSpp 开始翻倍；每轮结束按间隔保存断点
+	passTarget = adaptive ? std::max(1, minSpp) : (progressive ? 1 : spp);
+	auto lastCheckpoint = std::chrono::steady_clock::now();
+#ifdef RAYTRACING_STATS
+	auto renderStart = lastCheckpoint;
+#endif
+	STAT_RESET();
+	progress.start();
+	while (true) {
+		passTarget = std::min(passTarget, spp);
+		uint64_t before = progress.samples();
+		pool.parallelFor(tilesX * tilesY, castRayTile);
 
-	int strideX = (scene.width + 1) / bx;
-	int strideY = (scene.height + 1) / by;
-
-	// 分块计算光线追踪
-	for (int i = 0; i < scene.height; i += strideX)
-	{
-		for (int j = 0; j < scene.width; j += strideY)
-		{
-			th[id] = std::thread(castRayMultiThreading, i, std::min(i + strideX, scene.height), j, std::min(j + strideY, scene.width));
-			id++;
+		bool finished = passTarget >= spp;
+		auto now = std::chrono::steady_clock::now();
+		if (progressive && progress.samples() != before &&
+			(finished || now - lastCheckpoint >= std::chrono::seconds(checkpointInterval))) {
+			if (!film.saveCheckpoint(checkpointPath))
+				std::cout << "\nFailed to write checkpoint " << checkpointPath << "\n";
+			film.writePPM("binary.ppm");
+			if (!hdrPath.empty())
+				film.writeHDR(hdrPath);
+			lastCheckpoint = now;
 		}
+		if (finished)
+			break;
+		passTarget *= 2;
 	}
+	progress.stop();
+	std::cout << "\nAverage SPP: " << (double)film.totalSamples() / (scene.width * scene.height) << "\n";
+	// 只统计渲染循环，不含之后的特征缓冲和降噪
+	STAT_REPORT(std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count());
 
-	for (int i = 0; i < bx*by; i++) th[i].join();
-	UpdateProgress(1.f);
-
-    //for (uint32_t j = 0; j < scene.height; ++j) {
-    //    for (uint32_t i = 0; i < scene.width; ++i) {
-    //        // generate primary ray direction
-    //        float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-    //                  imageAspectRatio * scale;
-    //        float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-    //        Vector3f dir = normalize(Vector3f(-x, y, 1));
-    //        for (int k = 0; k < spp; k++){
-    //            framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;  
-    //        }
-    //        m++;
-    //    }
-    //    UpdateProgress(j / (float)scene.height);
-    //}
-    //UpdateProgress(1.f);
+	if (writeFeatures || denoise) {
+		// 主光线没有抖动，每个像素追踪一条即可得到特征
+		int n = scene.width * scene.height;
+		film.albedo.assign(n, Vector3f(0.0f));
+		film.normal.assign(n, Vector3f(0.0f));
+		film.depth.assign(n, std::numeric_limits<float>::infinity());
+		pool.parallelFor(scene.height, [&](int j, int) {
+			for (int i = 0; i < scene.width; ++i) {
+				Intersection hit = scene.intersect(Ray(eye_pos, primaryDir(i, j)));
+				if (!hit.happened)
+					continue;
+				int m = j * scene.width + i;
+				film.albedo[m] = hit.m->getAlbedo();
+				film.normal[m] = hit.normal;
+				film.depth[m] = hit.distance;
+			}
+		});
+		if (writeFeatures)
+			film.writeFeatures("");
+	}
 
     // save framebuffer to file
-    FILE* fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+	if (denoise) {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Vector3f> pixels = denoiser.run(film);
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		std::cout << "Denoise: " << ms.count() << " ms\n";
+		film.writePPM("binary_noisy.ppm");
+		writePPM("binary.ppm", scene.width, scene.height, pixels);
+		if (!hdrPath.empty()) {
+			size_t dot = hdrPath.find_last_of('.');
+			std::string noisy = dot == std::string::npos ? hdrPath + "_noisy"
+				: hdrPath.substr(0, dot) + "_noisy" + hdrPath.substr(dot);
+			film.writeHDR(noisy);
+			writeHDR(hdrPath, scene.width, scene.height, pixels);
+		}
+	}
+	else {
+		film.writePPM("binary.ppm");
+		if (!hdrPath.empty())
+			film.writeHDR(hdrPath);
+	}
 }
-
-
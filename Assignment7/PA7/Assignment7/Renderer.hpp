@@ -1,7 +1,9 @@
 //
 // Created by goksu on 2/25/20.
 //
+#include <string>
 #include "Scene.hpp"
+#include "Denoiser.hpp"
 
 #pragma once
 struct hit_payload
@@ -17,5 +19,37 @@ class Renderer
 public:
     void Render(const Scene& scene);
 
+    // 每个像素的样本数，自适应模式下为上限
+    int spp = 256;
+    // 自适应采样：至少 minSpp 个样本，之后相对误差低于 targetNoise 的像素停止采样
+    bool adaptive = false;
+    int minSpp = 16;
+    float targetNoise = 0.02f;
+    // 分块渲染时每个 tile 的边长（像素）
+    int tileSize = 16;
+    // 主光线按 4x4 像素块打包遍历 BVH
+    bool primaryPackets = true;
+    // 波前模式：按批追踪路径（见 WavefrontIntegrator），每批最多 wavefrontBatch 条
+    bool wavefront = false;
+    int wavefrontBatch = 1 << 14;
+
+    // 渐进渲染：按轮次累加样本，定期把累加缓冲写入断点文件
+    bool progressive = false;
+    bool resume = false;
+    std::string checkpointPath = "checkpoint.bin";
+    int checkpointInterval = 60; // 秒
+
+    // 与 binary.ppm 一起写出的浮点帧缓冲（.pfm 或 .exr），为空时不写；
+    // 之后可以用 tonemap 工具换曝光、gamma 重新生成 8 位图像而不用重新渲染
+    std::string hdrPath = "binary.pfm";
+
+    // 渲染结束后追踪一遍主光线，得到第一个交点的 albedo / 法线 / 深度特征缓冲。
+    // writeFeatures 把它们写成 albedo.ppm、normal.ppm、depth.ppm；
+    // denoise 用它们引导去噪，结果写入 binary.ppm / hdrPath，未去噪的图像改写到 binary_noisy.ppm
+    // 和 hdrPath 加 _noisy 后缀的文件
+    bool writeFeatures = false;
+    bool denoise = false;
+    Denoiser denoiser;
+
 private:
 };
@@ -0,0 +1,58 @@
+//
+// Per-sample random number generator (PCG32).
+//
+
+#ifndef RAYTRACING_SAMPLER_H
+#define RAYTRACING_SAMPLER_H
+
+#include <cstdint>
+
+// 每个 (像素, 样本序号) 各自构造一个 Sampler，渲染结果与线程数无关。
+// 算法见 https://www.pcg-random.org, pcg32 (XSH RR)
+class Sampler
+{
+public:
+    Sampler(uint64_t pixel, uint64_t sampleIndex)
+    {
+        seed(mix64((pixel << 32) ^ sampleIndex), pixel);
+    }
+
+    void seed(uint64_t initState, uint64_t initSeq)
+    {
+        state = 0;
+        inc = (initSeq << 1u) | 1u;
+        nextUInt();
+        state += initState;
+        nextUInt();
+    }
+
+    uint32_t nextUInt()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    }
+
+    // [0, 1) 均匀分布
+    float get1D()
+    {
+        return (nextUInt() >> 8) * 0x1p-24f;
+    }
+
+private:
+    // splitmix64 finalizer，把相邻的像素/样本序号打散
+    static uint64_t mix64(uint64_t z)
+    {
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t state;
+    uint64_t inc;
+};
+
+#endif //RAYTRACING_SAMPLER_H
@@ -3,37 +3,61 @@
 //
 
 #include "Scene.hpp"
+#include "Stats.hpp"
 
 
 void Scene::buildBVH() {
     printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    this->bvh = new BVHAccel(objects, 4, BVHAccel::SplitMethod::SAH);
+    this->lightDistribution = new LightDistribution(objects);
+    if (useLightBVH && !lightDistribution->empty())
+        this->lightBVH = new LightBVH(*lightDistribution);
 }
 
+// 每个线程各自计数，不需要同步
+static thread_local uint64_t tracedRays = 0;
+
+uint64_t Scene::raysTraced() { return tracedRays; }
+
 Intersection Scene::intersect(const Ray &ray) const
 {
+    ++tracedRays;
     return this->bvh->Intersect(ray);
 }
 
-void Scene::sampleLight(Intersection &pos, float &pdf) const
+bool Scene::intersectP(const Ray &ray) const
 {
-    float emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-        }
-    }
-    float p = get_random_float() * emit_area_sum;
-    emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-            if (p <= emit_area_sum){
-                objects[k]->Sample(pos, pdf);
-                break;
-            }
-        }
-    }
+    ++tracedRays;
+    return this->bvh->IntersectP(ray);
+}
+
+void Scene::intersectPacket(RayPacket &packet, uint32_t mask, Intersection *hits) const
+{
+    tracedRays += __builtin_popcount(mask);
+    this->bvh->IntersectPacket(packet, mask, hits);
+}
+
+void Scene::sampleLight(Intersection &pos, float &pdf, Sampler &sampler) const
+{
+    lightDistribution->sample(pos, pdf, sampler);
+}
+
+void Scene::sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf,
+                        Sampler &sampler) const
+{
+    if (lightBVH)
+        lightBVH->sample(p, n, pos, pdf, sampler);
+    else
+        lightDistribution->sample(pos, pdf, sampler);
+}
+
+float Scene::pdfLight(const Vector3f &p, const Vector3f &n, const Intersection &lightInter) const
+{
+    int i = lightDistribution->lightIndex(lightInter);
+    if (i < 0)
+        return 0.0f;
+    float pmf = lightBVH ? lightBVH->pmf(p, n, i) : lightDistribution->table.pmf[i];
+    return pmf * lightDistribution->pdfPrim(i);
 }
 
 bool Scene::trace(
@@ -58,71 +82,104 @@ bool Scene::trace(
 }
 
 // Implementation of Path Tracing
-Vector3f Scene::castRay(const Ray &ray, int depth) const
+Vector3f Scene::castRay(const Ray &ray, int depth, Sampler &sampler) const
+{
+    return castRay(ray, intersect(ray), depth, sampler);
+}
+
+Vector3f Scene::castRay(const Ray &ray, const Intersection &hit, int depth, Sampler &sampler) const
 {
     // TO DO Implement Path Tracing Algorithm here
-    
-    Intersection inter = intersect(ray);
 
-    if(inter.happened)
+    // 迭代实现：beta 为路径通量，每次弹射求交一次，交点直接留给下一次循环使用
+    Vector3f L(0, 0, 0);
+    Vector3f beta(1, 1, 1);
+    Ray r = ray;
+    Intersection inter = hit;
+    // 上一个顶点的法线和采样当前方向的 BSDF pdf，打中光源时计算 MIS 权重
+    Vector3f prevN;
+    float prevPdf = 0.0f;
+    STAT_ADD(paths, 1);
+
+    for (; inter.happened; ++depth)
     {
+        STAT_ADD(pathVertices, 1);
         //如果射线第一次打到光源，直接返回
         if(inter.m->hasEmission())
         {
             if(depth == 0)
+                L += inter.m->getEmission();
+            else if(dotProduct(-r.direction, inter.normal) > 0)
             {
-                return inter.m->getEmission();
+                // BSDF 采样打中光源：按光源采样得到同一点的 pdf 计算 MIS 权重
+                float d2 = inter.distance * inter.distance;
+                float pdf_light_w = pdfLight(r.origin, prevN, inter) * d2 / dotProduct(-r.direction, inter.normal);
+                L += beta * inter.m->getEmission() * powerHeuristic(prevPdf, pdf_light_w);
             }
-            else
-                return Vector3f(0, 0, 0);
+            break;
         }
 
-        Vector3f L_dir(0, 0, 0);
-        Vector3f L_indir(0, 0, 0);
+        // 物体表面法线
+        const Vector3f &N = inter.normal;
+        const Vector3f &objPos = inter.coords;
 
         // 随机 sample 灯光，用该 sample 的结果判断射线是否击中光源
         Intersection lightInter;
         float pdf_light = 0.0f;
-        sampleLight(lightInter, pdf_light);
+        sampleLight(objPos, N, lightInter, pdf_light, sampler);
 
-        // 物体表面法线
-        auto &N = inter.normal;
         // 灯光表面法线
         auto &NN = lightInter.normal;
-
-        auto &objPos = inter.coords;
         auto &lightPos = lightInter.coords;
 
         auto diff = lightPos - objPos;
         auto lightDir = diff.normalized();
         float lightDistance = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
 
+        // 阴影线段在光源采样点前一点截止，中间没有遮挡即可见
         Ray light(objPos, lightDir);
-        Intersection light2obj = intersect(light);
-        
+        light.t_max = std::sqrt(lightDistance) - 1e-2;
+
         // 如果反射击中光源
-        if(light2obj.happened && (light2obj.coords - lightPos).norm() < 1e-2)
+        // 光源采样与 BSDF 采样都能得到直接光照，按 power heuristic 加权合并 (MIS)
+        bool unoccluded = false;
+        if(pdf_light > 0 && dotProduct(lightDir, N) > 0 && dotProduct(-lightDir, NN) > 0)
         {
-            Vector3f f_r = inter.m->eval(ray.direction, lightDir, N);
-            L_dir = lightInter.emit * f_r * dotProduct(lightDir, N) * dotProduct(-lightDir, NN) / lightDistance / pdf_light;
+            STAT_ADD(shadowRays, 1);
+            unoccluded = !intersectP(light);
         }
-
-        if(get_random_float() < RussianRoulette)
+        if(unoccluded)
         {
-            Vector3f nextDir = inter.m->sample(ray.direction, N).normalized();
+            Vector3f f_r = inter.m->eval(r.direction, lightDir, N);
+            // 对面积的 pdf 换成对立体角的 pdf
+            float pdf_light_w = pdf_light * lightDistance / dotProduct(-lightDir, NN);
+            // 最后一个顶点之后不再做 BSDF 采样，光源采样独自负责直接光照，权重为 1
+            float w = depth + 1 >= maxDepth ? 1.0f : powerHeuristic(pdf_light_w, inter.m->pdf(r.direction, lightDir, N));
+            L += beta * lightInter.emit * f_r * dotProduct(lightDir, N) / pdf_light_w * w;
+        }
 
-            Ray nextRay(objPos, nextDir);
-            Intersection nextInter = intersect(nextRay);
-            if(nextInter.happened && !nextInter.m->hasEmission())
-            {
-                float pdf = inter.m->pdf(ray.direction, nextDir, N);
-                Vector3f f_r = inter.m->eval(ray.direction, nextDir, N);
-                L_indir = castRay(nextRay, depth + 1) * f_r * dotProduct(nextDir, N) / pdf / RussianRoulette;
-            }
+        // 达到最大弹射次数或俄罗斯轮盘赌失败时路径结束
+        if(depth + 1 >= maxDepth)
+            break;
+        if(sampler.get1D() >= RussianRoulette)
+        {
+            STAT_ADD(rouletteKills, 1);
+            break;
         }
 
-        return L_dir + L_indir;
+        Vector3f nextDir = inter.m->sample(r.direction, N, sampler).normalized();
+        float pdf = inter.m->pdf(r.direction, nextDir, N);
+        if(pdf <= 0)
+            break;
+        Vector3f f_r = inter.m->eval(r.direction, nextDir, N);
+        beta = beta * f_r * dotProduct(nextDir, N) / pdf / RussianRoulette;
+        prevN = N;
+        prevPdf = pdf;
+
+        r = Ray(objPos, nextDir);
+        STAT_ADD(indirectRays, 1);
+        inter = intersect(r);
     }
 
-    return Vector3f(0, 0, 0);
-}
\ No newline at end of file
+    return L;
+}
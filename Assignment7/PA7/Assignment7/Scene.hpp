@@ -10,6 +10,8 @@
 #include "Light.hpp"
 #include "AreaLight.hpp"
 #include "BVH.hpp"
+#include "LightDistribution.hpp"
+#include "LightBVH.hpp"
 #include "Ray.hpp"
 
 
@@ -20,8 +22,11 @@ public:
     int width = 1280;
     int height = 960;
     double fov = 40;
+    // 相机位置，相机朝 +z 方向
+    Vector3f eyePos = Vector3f(278, 273, -800);
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
-    int maxDepth = 1;
+    // 路径的最大弹射次数，castRay 与波前积分器都在此截断
+    int maxDepth = 64;
     float RussianRoulette = 0.8;
 
     Scene(int w, int h) : width(w), height(h)
@@ -33,10 +38,25 @@ public:
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
+    bool intersectP(const Ray& ray) const;
+    void intersectPacket(RayPacket &packet, uint32_t mask, Intersection *hits) const;
+    // 当前线程经上面三个函数追踪过的光线总数，用于显示渲染速度
+    static uint64_t raysTraced();
     BVHAccel *bvh;
+    // 发光图元表，在 buildBVH() 中与 BVH 一起构建
+    LightDistribution *lightDistribution = nullptr;
+    // 发光图元上的光源 BVH，按着色点选择光源；useLightBVH 为 false 时只用 lightDistribution 的全局分布
+    LightBVH *lightBVH = nullptr;
+    bool useLightBVH = true;
     void buildBVH();
-    Vector3f castRay(const Ray &ray, int depth) const;
-    void sampleLight(Intersection &pos, float &pdf) const;
+    Vector3f castRay(const Ray &ray, int depth, Sampler &sampler) const;
+    // hit 为 ray 的求交结果，主光线可以事先成批求交后传入
+    Vector3f castRay(const Ray &ray, const Intersection &hit, int depth, Sampler &sampler) const;
+    void sampleLight(Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 为着色点 p（法线 n）采样光源，照不到 p 的光源不会被选中；pdf 为 0 表示没有可用的光源
+    void sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 从着色点 p（法线 n）用 sampleLight 采样到光源上的点 lightInter 的概率密度（对面积），用于 MIS
+    float pdfLight(const Vector3f &p, const Vector3f &n, const Intersection &lightInter) const;
     bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
                                                    const Vector3f &shadowPointOrig,
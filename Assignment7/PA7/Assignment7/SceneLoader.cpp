@@ -0,0 +1,395 @@
+//
+// Text scene description loader with a content-hash keyed mesh cache.
+//
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <utility>
+#include "SceneLoader.hpp"
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "Sphere.hpp"
+#include "Instance.hpp"
+#include "MappedFile.hpp"
+// OBJ_Loader 只能被一个源文件包含，网格都经由加载器创建
+#include "Triangle.hpp"
+
+// 快照布局变化时加一，旧文件自动作废
+static const uint32_t meshCacheVersion = 2;
+
+// 快照中的数组，SoA 的 9 个数组在 SoA 存在时才写入
+enum MeshSection { Positions, Indices, V0x, V0y, V0z, E1x, E1y, E1z, E2x, E2y, E2z, Nodes, AreaCdf, NumSections };
+
+// 网格快照文件头。数组按本机字节序依次存放，起点按 64 字节对齐，
+// 映射后直接作为 TriangleMesh 和 BVH 的数组使用，不复制也没有指针需要修正
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint64_t contentHash;
+    uint64_t numPositions, numTriangles, numNodes;
+    uint64_t hasSoA;
+    uint64_t offset[NumSections];   // 相对文件开头，不存在的数组为 0
+};
+
+static const size_t sectionAlignment = 64;
+
+static size_t sectionElementSize(int s)
+{
+    if (s == Positions)
+        return sizeof(Vector3f);
+    if (s == Nodes)
+        return sizeof(LinearBVHNode);
+    return 4;   // uint32_t 下标和 float 数组
+}
+
+static uint64_t sectionCount(const MeshCacheHeader &h, int s)
+{
+    switch (s) {
+    case Positions: return h.numPositions;
+    case Indices: return 3 * h.numTriangles;
+    case Nodes: return h.numNodes;
+    case AreaCdf: return h.numTriangles;
+    default: return h.hasSoA ? h.numTriangles : 0;
+    }
+}
+
+// 与 MeshSection 中 V0x .. E2z 的顺序一致
+static Buffer<float>* soaArrays(TriangleMesh &mesh, int k)
+{
+    Buffer<float>* arrays[9] = {&mesh.v0x, &mesh.v0y, &mesh.v0z, &mesh.e1x, &mesh.e1y, &mesh.e1z,
+                                &mesh.e2x, &mesh.e2y, &mesh.e2z};
+    return arrays[k];
+}
+
+// FNV-1a 64 位哈希
+static uint64_t hashBytes(const std::string &data)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static bool readFile(const std::string &path, std::string &data)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+    char buffer[1 << 16];
+    size_t n;
+    data.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.append(buffer, n);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+Material* SceneLoader::material(const std::string &name) const
+{
+    auto it = materialByName.find(name);
+    return it == materialByName.end() ? nullptr : it->second;
+}
+
+Object* SceneLoader::loadMesh(const std::string &path, Material *m)
+{
+    std::string data;
+    if (!readFile(path, data))
+        return nullptr;
+    uint64_t hash = hashBytes(data);
+    auto it = meshByHash.find(hash);
+    if (it != meshByHash.end())
+        return it->second;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".mesh", hash);
+    std::string file = cacheDir.empty() ? "" : (std::filesystem::path(cacheDir) / name).string();
+
+    auto start = std::chrono::steady_clock::now();
+    MeshTriangle* mesh = file.empty() ? nullptr : readMeshCache(file, hash, m);
+    bool cached = mesh != nullptr;
+    if (!cached) {
+        mesh = new MeshTriangle(path, m);
+        if (!file.empty())
+            writeMeshCache(file, hash, mesh);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf(" - %s: %zu triangles %s in %.3f ms\n", path.c_str(), mesh->triangles.size(),
+           cached ? "mapped from snapshot" : "parsed", ms);
+    objects.emplace_back(mesh);
+    meshByHash[hash] = mesh;
+    return mesh;
+}
+
+MeshTriangle* SceneLoader::readMeshCache(const std::string &file, uint64_t hash, Material *m)
+{
+    std::unique_ptr<MappedFile> map(new MappedFile());
+    if (!map->open(file) || map->size() < sizeof(MeshCacheHeader))
+        return nullptr;
+    const MeshCacheHeader &h = *reinterpret_cast<const MeshCacheHeader*>(map->data());
+    if (memcmp(h.magic, "RTMESH", 7) || h.version != meshCacheVersion || h.nodeSize != sizeof(LinearBVHNode) ||
+        h.contentHash != hash || h.numNodes == 0 || h.numTriangles == 0)
+        return nullptr;
+    // 先检查文件头和各数组的范围，保证下面的视图都落在映射之内
+    for (int s = 0; s < NumSections; ++s) {
+        uint64_t count = sectionCount(h, s), size = map->size();
+        if (count == 0)
+            continue;
+        if (count > size / sectionElementSize(s) || h.offset[s] % sectionAlignment != 0 ||
+            h.offset[s] > size - count * sectionElementSize(s))
+            return nullptr;
+    }
+    auto section = [&](int s) { return map->data() + h.offset[s]; };
+
+    TriangleMesh mesh;
+    mesh.positions.view(reinterpret_cast<const Vector3f*>(section(Positions)), h.numPositions);
+    mesh.indices.view(reinterpret_cast<const uint32_t*>(section(Indices)), 3 * h.numTriangles);
+    if (h.hasSoA)
+        for (int k = 0; k < 9; ++k)
+            soaArrays(mesh, k)->view(reinterpret_cast<const float*>(section(V0x + k)), h.numTriangles);
+    Buffer<LinearBVHNode> nodes;
+    nodes.view(reinterpret_cast<const LinearBVHNode*>(section(Nodes)), h.numNodes);
+    Buffer<float> areaCdf;
+    areaCdf.view(reinterpret_cast<const float*>(section(AreaCdf)), h.numTriangles);
+
+    // 下标和节点链接在求交时直接用来寻址，损坏或被截断改写的快照会越界访问，
+    // 所以接受之前顺序检查一遍（只读一次，远快于解析 OBJ 和构建 BVH）
+    for (uint64_t i = 0; i < 3 * h.numTriangles; ++i)
+        if (std::as_const(mesh.indices)[i] >= h.numPositions)
+            return nullptr;
+    // 子节点总在父节点之后，顺序扫描时就能得到每个节点的深度，树深不能超过遍历栈的大小。
+    // 除根以外深度至少为 1，深度非 0 说明已经有父节点：被引用两次的节点会让深度记少，直接拒绝
+    std::vector<uint8_t> depth(h.numNodes, 0);
+    for (uint64_t i = 0; i < h.numNodes; ++i) {
+        const LinearBVHNode &node = std::as_const(nodes)[i];
+        if (node.nPrimitives > 0) {
+            if (node.primType != (uint8_t)PrimType::Triangle || node.primitivesOffset < 0 ||
+                (uint64_t)node.primitivesOffset + node.nPrimitives > h.numTriangles)
+                return nullptr;
+        }
+        else if (node.secondChildOffset <= 0 || (uint64_t)node.secondChildOffset <= i + 1 ||
+                 (uint64_t)node.secondChildOffset >= h.numNodes || depth[i] >= BVHAccel::maxTreeDepth ||
+                 depth[i + 1] != 0 || depth[node.secondChildOffset] != 0) {
+            return nullptr;
+        }
+        else {
+            depth[i + 1] = depth[node.secondChildOffset] = depth[i] + 1;
+        }
+    }
+
+    mappings.push_back(std::move(map));
+    return new MeshTriangle(std::move(mesh), m, std::move(nodes), std::move(areaCdf));
+}
+
+void SceneLoader::writeMeshCache(const std::string &file, uint64_t hash, MeshTriangle *mesh) const
+{
+    TriangleMesh &tris = mesh->triangles;
+    const BVHAccel &bvh = *mesh->bvh;
+    if (bvh.nodes.empty())
+        return;
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+
+    MeshCacheHeader header = {};
+    memcpy(header.magic, "RTMESH", 7);
+    header.version = meshCacheVersion;
+    header.nodeSize = sizeof(LinearBVHNode);
+    header.contentHash = hash;
+    header.numPositions = tris.positions.size();
+    header.numTriangles = tris.size();
+    header.numNodes = bvh.nodes.size();
+    header.hasSoA = tris.hasSoA();
+
+    const void* data[NumSections] = {tris.positions.data(), tris.indices.data()};
+    for (int k = 0; k < 9; ++k)
+        data[V0x + k] = soaArrays(tris, k)->data();
+    data[Nodes] = bvh.nodes.data();
+    data[AreaCdf] = bvh.areaCdf.data();
+    uint64_t end = sizeof(header);
+    for (int s = 0; s < NumSections; ++s) {
+        if (sectionCount(header, s) == 0)
+            continue;
+        header.offset[s] = (end + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+        end = header.offset[s] + sectionCount(header, s) * sectionElementSize(s);
+    }
+
+    // 先写临时文件再改名，同时运行的其他进程不会读到写了一半的快照。
+    // 临时文件名带随机后缀：几个进程同时缺同一个快照时各写各的，不会互相截断，最后一次改名生效
+    std::random_device rd;
+    uint64_t tag = (uint64_t(rd()) << 32 | rd()) ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%016" PRIx64 ".tmp", tag);
+    std::string tmp = file + suffix;
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+        return;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    uint64_t written = sizeof(header);
+    static const char zeros[sectionAlignment] = {};
+    for (int s = 0; ok && s < NumSections; ++s) {
+        uint64_t count = sectionCount(header, s);
+        if (count == 0)
+            continue;
+        ok = fwrite(zeros, 1, header.offset[s] - written, fp) == header.offset[s] - written &&
+             fwrite(data[s], sectionElementSize(s), count, fp) == count;
+        written = header.offset[s] + count * sectionElementSize(s);
+    }
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+        std::filesystem::rename(tmp, file, ec);
+    if (!ok || ec)
+        std::filesystem::remove(tmp, ec);
+}
+
+static bool readVector(std::istream &in, Vector3f &v)
+{
+    return (bool)(in >> v.x >> v.y >> v.z);
+}
+
+bool SceneLoader::load(const std::string &path, Scene &scene, Renderer &renderer)
+{
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Cannot open scene %s\n", path.c_str());
+        return false;
+    }
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+
+    std::string line;
+    int lineNumber = 0;
+    auto fail = [&](const std::string &message) {
+        fprintf(stderr, "%s:%d: %s\n", path.c_str(), lineNumber, message.c_str());
+        return false;
+    };
+
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword))
+            continue;
+
+        if (keyword == "film") {
+            if (!(in >> scene.width >> scene.height) || scene.width <= 0 || scene.height <= 0)
+                return fail("expected: film WIDTH HEIGHT");
+        }
+        else if (keyword == "spp") {
+            if (!(in >> renderer.spp) || renderer.spp <= 0)
+                return fail("expected: spp N");
+        }
+        else if (keyword == "maxdepth") {
+            if (!(in >> scene.maxDepth) || scene.maxDepth <= 0)
+                return fail("expected: maxdepth N");
+        }
+        else if (keyword == "camera") {
+            if (!readVector(in, scene.eyePos) || !(in >> scene.fov))
+                return fail("expected: camera X Y Z FOV");
+        }
+        else if (keyword == "material") {
+            std::string name, type;
+            if (!(in >> name >> type))
+                return fail("expected: material NAME TYPE ...");
+            if (materialByName.count(name))
+                return fail("material " + name + " redefined");
+            MaterialType t;
+            if (type == "diffuse")
+                t = DIFFUSE;
+            else if (type == "microfacet")
+                t = Microfacet;
+            else
+                return fail("unknown material type " + type);
+
+            Vector3f kd(0.0f), ks(0.0f), emission(0.0f);
+            float roughness = 0.35f, ior = 1.85f;
+            std::string key;
+            while (in >> key) {
+                bool ok;
+                if (key == "kd")
+                    ok = readVector(in, kd);
+                else if (key == "ks")
+                    ok = readVector(in, ks);
+                else if (key == "emission")
+                    ok = readVector(in, emission);
+                else if (key == "roughness")
+                    ok = (bool)(in >> roughness);
+                else if (key == "ior")
+                    ok = (bool)(in >> ior) && ior > 0;
+                else
+                    return fail("unknown material parameter " + key);
+                if (!ok)
+                    return fail("bad value for " + key);
+            }
+            Material* m = new Material(t, emission);
+            m->Kd = kd;
+            m->Ks = ks;
+            m->roughness = roughness;
+            m->ior = ior;
+            materials.emplace_back(m);
+            materialByName[name] = m;
+        }
+        else if (keyword == "mesh" || keyword == "instance") {
+            std::string meshPath, materialName;
+            if (!(in >> meshPath >> materialName))
+                return fail("expected: " + keyword + " PATH MATERIAL");
+            Material* m = material(materialName);
+            if (!m)
+                return fail("unknown material " + materialName);
+            std::string resolved = (dir / meshPath).string();
+            Object* mesh = loadMesh(resolved, m);
+            if (!mesh)
+                return fail("cannot read mesh " + resolved);
+
+            Transform toWorld;
+            std::string op;
+            while (keyword == "instance" && in >> op) {
+                Vector3f v;
+                float degrees;
+                if (op == "translate" && readVector(in, v))
+                    toWorld = toWorld * Transform::translate(v);
+                else if (op == "rotate" && readVector(in, v) && in >> degrees)
+                    toWorld = toWorld * Transform::rotate(v, degrees);
+                else if (op == "scale" && readVector(in, v))
+                    toWorld = toWorld * Transform::scale(v);
+                else
+                    return fail("bad transform " + op);
+            }
+
+            // 第一次以原材质直接加入的网格用原型本身，其余都是共享它的实例
+            if (keyword == "mesh" && !placedMeshes.count(mesh) && static_cast<MeshTriangle*>(mesh)->m == m) {
+                placedMeshes.insert(mesh);
+                scene.Add(mesh);
+            }
+            else {
+                objects.emplace_back(new Instance(mesh, toWorld, m));
+                scene.Add(objects.back().get());
+            }
+        }
+        else if (keyword == "sphere") {
+            Vector3f center;
+            float radius;
+            std::string materialName;
+            if (!readVector(in, center) || !(in >> radius >> materialName) || radius <= 0)
+                return fail("expected: sphere X Y Z RADIUS MATERIAL");
+            Material* m = material(materialName);
+            if (!m)
+                return fail("unknown material " + materialName);
+            objects.emplace_back(new Sphere(center, radius, m));
+            scene.Add(objects.back().get());
+        }
+        else {
+            return fail("unknown keyword " + keyword);
+        }
+    }
+    return true;
+}
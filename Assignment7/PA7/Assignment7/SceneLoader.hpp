@@ -0,0 +1,61 @@
+//
+// Text scene description loader with a content-hash keyed mesh cache.
+//
+
+#ifndef RAYTRACING_SCENELOADER_H
+#define RAYTRACING_SCENELOADER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "global.hpp"
+#include "MappedFile.hpp"
+#include "Material.hpp"
+#include "Object.hpp"
+
+class Scene;
+class Renderer;
+class MeshTriangle;
+
+// 读取文本场景文件（格式见 scenes/cornellbox.scene），创建材质和物体加入 Scene，
+// 并设置分辨率、相机、最大弹射次数和 Renderer 的样本数。创建的对象归加载器所有，渲染结束前不能销毁。
+//
+// OBJ 网格按文件内容的 64 位哈希缓存：内容相同的网格只解析一次，之后的引用成为共享网格和 BVH 的实例。
+// cacheDir 非空时，去重后的顶点、按叶节点排列的下标、SoA 求交布局、BVH 节点和面积 CDF
+// 写成快照 cacheDir/<hash>.mesh；之后的运行 mmap 快照并原地使用，跳过 OBJ 解析和 BVH 构建。
+// 场景顶层 BVH 引用的是本次运行创建的物体，每次重新构建（图元只有物体和实例，很快）
+class SceneLoader
+{
+public:
+    // 出错时把 "文件:行号: 原因" 打印到 stderr 并返回 false
+    bool load(const std::string &path, Scene &scene, Renderer &renderer);
+
+    // 按名字查找场景文件中声明的材质，没有时返回 nullptr
+    Material* material(const std::string &name) const;
+
+    // 按内容取得网格原型（第一次遇到时解析或读缓存，材质为 m），读不到文件时返回 nullptr。
+    // 原型本身不加入场景，需要时由调用者加入或为它创建实例
+    Object* loadMesh(const std::string &path, Material *m);
+
+    // 网格缓存目录，为空时不读写磁盘缓存
+    std::string cacheDir = ".scenecache";
+
+private:
+    // 映射快照文件创建网格，文件不存在、版本不符、大小不对或下标和节点链接越界时返回 nullptr
+    MeshTriangle* readMeshCache(const std::string &file, uint64_t hash, Material *m);
+    void writeMeshCache(const std::string &file, uint64_t hash, MeshTriangle *mesh) const;
+
+    // 网格快照的映射，网格的数组直接指向这里，所以声明在 objects 之前、最后析构
+    std::vector<std::unique_ptr<MappedFile>> mappings;
+    std::vector<std::unique_ptr<Material>> materials;
+    std::vector<std::unique_ptr<Object>> objects;
+    std::unordered_map<std::string, Material*> materialByName;
+    std::unordered_map<uint64_t, Object*> meshByHash;
+    // 已经直接加入场景的网格原型，再次引用时改为实例
+    std::unordered_set<Object*> placedMeshes;
+};
+
+#endif //RAYTRACING_SCENELOADER_H
@@ -9,6 +9,7 @@
 #include "Vector.hpp"
 #include "Bounds3.hpp"
 #include "Material.hpp"
+#include "Stats.hpp"
 
 class Sphere : public Object{
 public:
@@ -17,19 +18,25 @@ public:
     Material *m;
     float area;
     Sphere(const Vector3f &c, const float &r, Material* mt = new Material()) : center(c), radius(r), radius2(r * r), m(mt), area(4 * M_PI *r *r) {}
-    bool intersect(const Ray& ray) {
-        // analytic solution
+    // 解析求交，只接受 (0.5, ray.t_max] 内的根；BVH 叶节点直接调用，不经过虚函数
+    static bool hit(const Vector3f &center, float radius2, const Ray &ray, float &t)
+    {
+        STAT_ADD(sphereTests, 1);
         Vector3f L = ray.origin - center;
         float a = dotProduct(ray.direction, ray.direction);
         float b = 2 * dotProduct(ray.direction, L);
         float c = dotProduct(L, L) - radius2;
         float t0, t1;
-        float area = 4 * M_PI * radius2;
         if (!solveQuadratic(a, b, c, t0, t1)) return false;
         if (t0 < 0) t0 = t1;
-        if (t0 < 0) return false;
+        if (!(t0 > 0.5 && t0 <= ray.t_max)) return false;
+        t = t0;
         return true;
     }
+    bool intersect(const Ray& ray) {
+        float t;
+        return hit(center, radius2, ray, t);
+    }
     bool intersect(const Ray& ray, float &tnear, uint32_t &index) const
     {
         // analytic solution
@@ -49,16 +56,8 @@ public:
     Intersection getIntersection(Ray ray){
         Intersection result;
         result.happened = false;
-        Vector3f L = ray.origin - center;
-        float a = dotProduct(ray.direction, ray.direction);
-        float b = 2 * dotProduct(ray.direction, L);
-        float c = dotProduct(L, L) - radius2;
-        float t0, t1;
-        if (!solveQuadratic(a, b, c, t0, t1)) return result;
-        if (t0 < 0) t0 = t1;
-        if (t0 < 0) return result;
-        
-        if(t0 > 0.5)
+        float t0;
+        if (hit(center, radius2, ray, t0))
         {
             result.happened=true;
             result.coords = Vector3f(ray.origin + ray.direction * t0);
@@ -82,8 +81,8 @@ public:
         return Bounds3(Vector3f(center.x-radius, center.y-radius, center.z-radius),
                        Vector3f(center.x+radius, center.y+radius, center.z+radius));
     }
-    void Sample(Intersection &pos, float &pdf){
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
+        float theta = 2.0 * M_PI * sampler.get1D(), phi = M_PI * sampler.get1D();
         Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
         pos.coords = center + radius * dir;
         pos.normal = dir;
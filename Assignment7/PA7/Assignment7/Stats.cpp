@@ -0,0 +1,84 @@
+//
+// Per-thread ray tracing statistics, compiled out unless RAYTRACING_STATS is defined.
+//
+
+#include "Stats.hpp"
+
+StatCounters &StatCounters::operator+=(const StatCounters &o)
+{
+    primaryRays += o.primaryRays;
+    shadowRays += o.shadowRays;
+    indirectRays += o.indirectRays;
+    nodesVisited += o.nodesVisited;
+    boxTests += o.boxTests;
+    triangleTests += o.triangleTests;
+    sphereTests += o.sphereTests;
+    paths += o.paths;
+    pathVertices += o.pathVertices;
+    rouletteKills += o.rouletteKills;
+    return *this;
+}
+
+#ifdef RAYTRACING_STATS
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<StatCounters>> registry;
+
+StatCounters *Stats::registerThread()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.emplace_back(new StatCounters());
+    return registry.back().get();
+}
+
+void Stats::reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto &c : registry)
+        *c = StatCounters();
+}
+
+StatCounters Stats::merged()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    StatCounters total;
+    for (auto &c : registry)
+        total += *c;
+    return total;
+}
+
+void Stats::report(double seconds)
+{
+    StatCounters s = merged();
+    uint64_t rays = s.rays();
+    double perRay = rays ? 1.0 / rays : 0.0;
+    printf("Rays: %.2fM (primary %.2fM, shadow %.2fM, indirect %.2fM), %.2f Mrays/s\n", rays * 1e-6,
+           s.primaryRays * 1e-6, s.shadowRays * 1e-6, s.indirectRays * 1e-6,
+           seconds > 0 ? rays * 1e-6 / seconds : 0.0);
+    printf("Per ray: %.1f nodes, %.1f box tests, %.2f triangle tests, %.2f sphere tests\n",
+           s.nodesVisited * perRay, s.boxTests * perRay, s.triangleTests * perRay, s.sphereTests * perRay);
+    printf("Paths: %.2fM, average length %.2f vertices, %.2fM ended by Russian roulette\n", s.paths * 1e-6,
+           s.paths ? (double)s.pathVertices / s.paths : 0.0, s.rouletteKills * 1e-6);
+
+    // 各线程光线数差距大时说明任务划分不均
+    std::lock_guard<std::mutex> lock(registryMutex);
+    uint64_t lo = UINT64_MAX, hi = 0;
+    int threads = 0;
+    for (auto &c : registry) {
+        if (!c->rays())
+            continue;
+        lo = std::min(lo, c->rays());
+        hi = std::max(hi, c->rays());
+        ++threads;
+    }
+    if (threads > 0)
+        printf("Threads: %d tracing, rays per thread %.2fM .. %.2fM\n", threads, lo * 1e-6, hi * 1e-6);
+}
+
+#endif
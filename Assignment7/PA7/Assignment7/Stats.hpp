@@ -0,0 +1,56 @@
+//
+// Per-thread ray tracing statistics, compiled out unless RAYTRACING_STATS is defined.
+//
+
+#ifndef RAYTRACING_STATS_H
+#define RAYTRACING_STATS_H
+
+#include <cstdint>
+
+// 渲染统计。每个线程累加自己的一份，不需要原子操作，渲染结束后合并
+struct StatCounters
+{
+    uint64_t primaryRays = 0, shadowRays = 0, indirectRays = 0;
+    uint64_t nodesVisited = 0;       // BVH 节点访问次数（光线包访问一个节点算一次）
+    uint64_t boxTests = 0;           // 光线-包围盒测试次数（宽节点每个子节点算一次）
+    uint64_t triangleTests = 0, sphereTests = 0;
+    uint64_t paths = 0, pathVertices = 0;
+    uint64_t rouletteKills = 0;      // 俄罗斯轮盘赌结束的路径
+
+    uint64_t rays() const { return primaryRays + shadowRays + indirectRays; }
+    StatCounters &operator+=(const StatCounters &o);
+};
+
+#ifdef RAYTRACING_STATS
+
+namespace Stats
+{
+    // 为当前线程分配一份计数器并登记，线程结束后计数器仍然保留
+    StatCounters *registerThread();
+
+    inline StatCounters &local()
+    {
+        static thread_local StatCounters *counters = registerThread();
+        return *counters;
+    }
+
+    // 以下在没有线程计数时调用（例如两次 parallelFor 之间）
+    void reset();
+    StatCounters merged();
+    // 打印合并后的统计，seconds 为渲染用时
+    void report(double seconds);
+}
+
+#define STAT_ADD(counter, n) (Stats::local().counter += (n))
+#define STAT_RESET() Stats::reset()
+#define STAT_REPORT(seconds) Stats::report(seconds)
+
+#else
+
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_RESET() ((void)0)
+#define STAT_REPORT(seconds) ((void)0)
+
+#endif
+
+#endif //RAYTRACING_STATS_H
@@ -0,0 +1,123 @@
+//
+// Persistent worker pool with per-worker deques and work stealing.
+//
+
+#include "ThreadPool.hpp"
+
+static thread_local int workerIndex = -1;
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads <= 0)
+        numThreads = 1;
+
+    for (int i = 0; i < numThreads; ++i)
+        queues.emplace_back(new WorkerQueue());
+    for (int i = 0; i < numThreads; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    for (auto& t : workers)
+        t.join();
+}
+
+int ThreadPool::currentWorker() { return workerIndex; }
+
+ThreadPool& ThreadPool::global(int numThreads)
+{
+    static ThreadPool pool(numThreads);
+    return pool;
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)>& func)
+{
+    if (count <= 0)
+        return;
+
+    std::lock_guard<std::mutex> submit(submitMutex);
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // 连续的任务分给同一个 worker，保持相邻 tile 的缓存局部性
+    int n = size();
+    for (int i = 0; i < count; ++i) {
+        auto& q = *queues[(int64_t)i * n / count];
+        std::lock_guard<std::mutex> g(q.mutex);
+        q.tasks.push_back(i);
+    }
+    job = &func;
+    remaining = count;
+    ++generation;
+    wakeCv.notify_all();
+
+    doneCv.wait(lock, [this] { return remaining == 0 && active == 0; });
+    job = nullptr;
+}
+
+bool ThreadPool::popTask(int id, int& task)
+{
+    // 先从自己队列头部取
+    {
+        auto& q = *queues[id];
+        std::lock_guard<std::mutex> g(q.mutex);
+        if (!q.tasks.empty()) {
+            task = q.tasks.front();
+            q.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // 自己的做完了，从其他 worker 队列尾部偷
+    int n = size();
+    for (int k = 1; k < n; ++k) {
+        auto& q = *queues[(id + k) % n];
+        std::lock_guard<std::mutex> g(q.mutex);
+        if (!q.tasks.empty()) {
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int id)
+{
+    workerIndex = id;
+    uint64_t seen = 0;
+
+    while (true) {
+        const std::function<void(int, int)>* func;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            func = job;
+            if (!func)
+                continue;
+            ++active;
+        }
+
+        int done = 0, task;
+        while (popTask(id, task)) {
+            (*func)(task, id);
+            ++done;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining -= done;
+        --active;
+        if (remaining == 0 && active == 0)
+            doneCv.notify_all();
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Persistent worker pool with per-worker deques and work stealing.
+//
+
+#ifndef RAYTRACING_THREADPOOL_H
+#define RAYTRACING_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // numThreads <= 0 时使用 std::thread::hardware_concurrency()
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)workers.size(); }
+
+    // 执行 func(task, worker)，task 取 [0, count)，阻塞直到全部完成。
+    // 任务按连续区间预先分到各 worker 的队列，空闲的 worker 从别人队列尾部偷任务。
+    // 不能在 worker 线程内部嵌套调用。
+    void parallelFor(int count, const std::function<void(int, int)>& func);
+
+    // 当前线程在池中的编号，不是 worker 时返回 -1
+    static int currentWorker();
+
+    // 全局线程池，第一次调用时按 numThreads 创建，之后的参数被忽略
+    static ThreadPool& global(int numThreads = 0);
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(int id);
+    bool popTask(int id, int& task);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable wakeCv;
+    std::condition_variable doneCv;
+    const std::function<void(int, int)>* job = nullptr;
+    uint64_t generation = 0;
+    int remaining = 0;
+    int active = 0;
+    bool stopping = false;
+
+    // 防止多个线程同时提交任务
+    std::mutex submitMutex;
+};
+
+#endif //RAYTRACING_THREADPOOL_H
@@ -0,0 +1,61 @@
+//
+// Tone mapping from HDR radiance to displayable [0, 1] values.
+//
+
+#ifndef RAYTRACING_TONEMAP_H
+#define RAYTRACING_TONEMAP_H
+
+#include <cmath>
+#include <cstring>
+#include "Vector.hpp"
+
+// 曝光 (EV) 之后做色调映射，gamma 由 writePPM 处理。
+// 缺省参数 (Clamp, 0 EV, gamma 0.6) 与渲染器直接写出的 binary.ppm 完全相同
+struct ToneMap
+{
+    enum Operator { Clamp, Reinhard, ACES };
+
+    Operator op = Clamp;
+    float exposure = 0.0f;
+    float gamma = 0.6f;
+
+    Vector3f operator()(const Vector3f &radiance) const
+    {
+        Vector3f c = radiance * std::exp2(exposure);
+        switch (op) {
+        case Reinhard:
+        {
+            // 按亮度压缩，保持色相
+            float y = 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+            return c / (1.0f + y);
+        }
+        case ACES:
+            // Narkowicz 的 ACES 拟合曲线
+            return Vector3f(aces(c.x), aces(c.y), aces(c.z));
+        default:
+            return c;
+        }
+    }
+
+    // 解析 clamp / reinhard / aces，无法识别时返回 false
+    bool setOperator(const char* name)
+    {
+        if (!strcmp(name, "clamp"))
+            op = Clamp;
+        else if (!strcmp(name, "reinhard"))
+            op = Reinhard;
+        else if (!strcmp(name, "aces"))
+            op = ACES;
+        else
+            return false;
+        return true;
+    }
+
+private:
+    static float aces(float x)
+    {
+        return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    }
+};
+
+#endif //RAYTRACING_TONEMAP_H
@@ -0,0 +1,132 @@
+//
+// Affine 3x4 transform used to place mesh instances in the scene.
+//
+
+#ifndef RAYTRACING_TRANSFORM_H
+#define RAYTRACING_TRANSFORM_H
+
+#include <cmath>
+#include "Vector.hpp"
+#include "Bounds3.hpp"
+
+// 仿射变换矩阵的前三行，第四行固定为 (0, 0, 0, 1)
+struct Transform
+{
+    float m[3][4];
+
+    Transform()
+    {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = i == j ? 1.f : 0.f;
+    }
+
+    static Transform translate(const Vector3f &t)
+    {
+        Transform r;
+        r.m[0][3] = t.x; r.m[1][3] = t.y; r.m[2][3] = t.z;
+        return r;
+    }
+
+    static Transform scale(const Vector3f &s)
+    {
+        Transform r;
+        r.m[0][0] = s.x; r.m[1][1] = s.y; r.m[2][2] = s.z;
+        return r;
+    }
+
+    // 绕 axis 旋转 degrees 度（右手系）
+    static Transform rotate(const Vector3f &axis, float degrees)
+    {
+        Vector3f a = normalize(axis);
+        float theta = degrees * M_PI / 180.f;
+        float s = std::sin(theta), c = std::cos(theta);
+        Transform r;
+        r.m[0][0] = a.x * a.x + (1 - a.x * a.x) * c;
+        r.m[0][1] = a.x * a.y * (1 - c) - a.z * s;
+        r.m[0][2] = a.x * a.z * (1 - c) + a.y * s;
+        r.m[1][0] = a.x * a.y * (1 - c) + a.z * s;
+        r.m[1][1] = a.y * a.y + (1 - a.y * a.y) * c;
+        r.m[1][2] = a.y * a.z * (1 - c) - a.x * s;
+        r.m[2][0] = a.x * a.z * (1 - c) - a.y * s;
+        r.m[2][1] = a.y * a.z * (1 - c) + a.x * s;
+        r.m[2][2] = a.z * a.z + (1 - a.z * a.z) * c;
+        return r;
+    }
+
+    // (*this) * t：先做 t，再做 *this
+    Transform operator*(const Transform &t) const
+    {
+        Transform r;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                r.m[i][j] = m[i][0] * t.m[0][j] + m[i][1] * t.m[1][j] + m[i][2] * t.m[2][j];
+                if (j == 3)
+                    r.m[i][j] += m[i][3];
+            }
+        }
+        return r;
+    }
+
+    // 线性部分的行列式
+    float det() const
+    {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+               m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+               m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    Transform inverse() const
+    {
+        float invDet = 1.f / det();
+        Transform r;
+        r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        for (int i = 0; i < 3; ++i)
+            r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+        return r;
+    }
+
+    Vector3f point(const Vector3f &p) const
+    {
+        return Vector3f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    Vector3f vector(const Vector3f &v) const
+    {
+        return Vector3f(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // 乘以线性部分的转置；在逆变换上调用即得到正确的法线变换 (M^-T n)，结果未归一化
+    Vector3f normal(const Vector3f &n) const
+    {
+        return Vector3f(m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+                        m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+                        m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z);
+    }
+
+    // 变换 8 个角点后的包围盒
+    Bounds3 bounds(const Bounds3 &b) const
+    {
+        Bounds3 r;
+        for (int i = 0; i < 8; ++i) {
+            Vector3f corner((i & 1) ? b.pMax.x : b.pMin.x, (i & 2) ? b.pMax.y : b.pMin.y,
+                            (i & 4) ? b.pMax.z : b.pMin.z);
+            r = Union(r, point(corner));
+        }
+        return r;
+    }
+};
+
+#endif //RAYTRACING_TRANSFORM_H
@@ -8,6 +8,8 @@
 #include "Triangle.hpp"
 #include <cassert>
 #include <array>
+#include <string>
+#include <unordered_map>
 
 bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
                           const Vector3f& v2, const Vector3f& orig,
@@ -62,6 +64,8 @@ public:
     bool intersect(const Ray& ray, float& tnear,
                    uint32_t& index) const override;
     Intersection getIntersection(Ray ray) override;
+    // Moller-Trumbore, 命中 [0, ray.t_max] 时返回 true 并写入 t
+    bool rayHit(const Ray& ray, double& t) const;
     void getSurfaceProperties(const Vector3f& P, const Vector3f& I,
                               const uint32_t& index, const Vector2f& uv,
                               Vector3f& N, Vector2f& st) const override
@@ -72,8 +76,8 @@ public:
     }
     Vector3f evalDiffuseColor(const Vector2f&) const override;
     Bounds3 getBounds() override;
-    void Sample(Intersection &pos, float &pdf){
-        float x = std::sqrt(get_random_float()), y = get_random_float();
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
+        float x = std::sqrt(sampler.get1D()), y = sampler.get1D();
         pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
         pos.normal = this->normal;
         pdf = 1.0f / area;
@@ -86,6 +90,7 @@ public:
     }
 };
 
+// 三角形网格：顶点和下标存放在 TriangleMesh 中，BVH 直接以三角形下标为图元
 class MeshTriangle : public Object
 {
 public:
@@ -93,61 +98,41 @@ public:
     {
         objl::Loader loader;
         loader.LoadFile(filename);
-        area = 0;
-        m = mt;
         assert(loader.LoadedMeshes.size() == 1);
         auto mesh = loader.LoadedMeshes[0];
 
-        Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity()};
-        Vector3f max_vert = Vector3f{-std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity()};
-        for (int i = 0; i < mesh.Vertices.size(); i += 3) {
-            std::array<Vector3f, 3> face_vertices;
-
-            for (int j = 0; j < 3; j++) {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
-                face_vertices[j] = vert;
-
-                min_vert = Vector3f(std::min(min_vert.x, vert.x),
-                                    std::min(min_vert.y, vert.y),
-                                    std::min(min_vert.z, vert.z));
-                max_vert = Vector3f(std::max(max_vert.x, vert.x),
-                                    std::max(max_vert.y, vert.y),
-                                    std::max(max_vert.z, vert.z));
-            }
-
-            triangles.emplace_back(face_vertices[0], face_vertices[1],
-                                   face_vertices[2], mt);
+        // OBJ_Loader 为每个面复制一份顶点，这里按位置去重成共享顶点
+        std::unordered_map<std::string, uint32_t> vertexIds;
+        for (unsigned int index : mesh.Indices) {
+            auto vert = Vector3f(mesh.Vertices[index].Position.X,
+                                 mesh.Vertices[index].Position.Y,
+                                 mesh.Vertices[index].Position.Z);
+            std::string key(reinterpret_cast<const char*>(&vert), sizeof(Vector3f));
+            auto it = vertexIds.emplace(key, (uint32_t)triangles.positions.size());
+            if (it.second)
+                triangles.positions.push_back(vert);
+            triangles.indices.push_back(it.first->second);
         }
+        triangles.indices.resize(triangles.indices.size() / 3 * 3);
+        init(mt, {}, {});
+    }
 
-        bounding_box = Bounds3(min_vert, max_vert);
-
-        std::vector<Object*> ptrs;
-        for (auto& tri : triangles){
-            ptrs.push_back(&tri);
-            area += tri.area;
-        }
-        bvh = new BVHAccel(ptrs);
+    // 由已经去重的网格构建，场景加载器映射网格快照时使用，mesh 的数组可以是快照的视图。
+    // nodes 非空时是按 indices 当前顺序构建好的 BVH，areaCdf 是对应的面积累加，直接采用而不重新计算
+    MeshTriangle(TriangleMesh mesh, Material *mt, Buffer<LinearBVHNode> nodes = {}, Buffer<float> areaCdf = {})
+        : triangles(std::move(mesh))
+    {
+        init(mt, std::move(nodes), std::move(areaCdf));
     }
 
-    bool intersect(const Ray& ray) { return true; }
+    bool intersect(const Ray& ray) { return bvh && bvh->IntersectP(ray); }
 
     bool intersect(const Ray& ray, float& tnear, uint32_t& index) const
     {
         bool intersect = false;
-        for (uint32_t k = 0; k < numTriangles; ++k) {
-            const Vector3f& v0 = vertices[vertexIndex[k * 3]];
-            const Vector3f& v1 = vertices[vertexIndex[k * 3 + 1]];
-            const Vector3f& v2 = vertices[vertexIndex[k * 3 + 2]];
-            float t, u, v;
-            if (rayTriangleIntersect(v0, v1, v2, ray.origin, ray.direction, t,
-                                     u, v) &&
-                t < tnear) {
+        for (uint32_t k = 0; k < triangles.size(); ++k) {
+            double t;
+            if (triangles.rayHit(k, ray, t) && t < tnear) {
                 tnear = t;
                 index = k;
                 intersect |= true;
@@ -159,20 +144,17 @@ public:
 
     Bounds3 getBounds() { return bounding_box; }
 
+    const BVHAccel* getAccel() const { return bvh; }
+
     void getSurfaceProperties(const Vector3f& P, const Vector3f& I,
                               const uint32_t& index, const Vector2f& uv,
                               Vector3f& N, Vector2f& st) const
     {
-        const Vector3f& v0 = vertices[vertexIndex[index * 3]];
-        const Vector3f& v1 = vertices[vertexIndex[index * 3 + 1]];
-        const Vector3f& v2 = vertices[vertexIndex[index * 3 + 2]];
-        Vector3f e0 = normalize(v1 - v0);
-        Vector3f e1 = normalize(v2 - v1);
-        N = normalize(crossProduct(e0, e1));
-        const Vector2f& st0 = stCoordinates[vertexIndex[index * 3]];
-        const Vector2f& st1 = stCoordinates[vertexIndex[index * 3 + 1]];
-        const Vector2f& st2 = stCoordinates[vertexIndex[index * 3 + 2]];
-        st = st0 * (1 - uv.x - uv.y) + st1 * uv.x + st2 * uv.y;
+        Vector3f v0, e1, e2;
+        triangles.getVertices(index, v0, e1, e2);
+        N = normalize(crossProduct(e1, e2));
+        // 网格没有纹理坐标
+        st = Vector2f(0, 0);
     }
 
     Vector3f evalDiffuseColor(const Vector2f& st) const
@@ -194,9 +176,15 @@ public:
 
         return intersec;
     }
+
+    void intersectPacket(RayPacket &packet, uint32_t mask, Intersection *hits)
+    {
+        if (bvh)
+            bvh->IntersectPacket(packet, mask, hits);
+    }
     
-    void Sample(Intersection &pos, float &pdf){
-        bvh->Sample(pos, pdf);
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
+        bvh->Sample(pos, pdf, sampler);
         pos.emit = m->getEmission();
     }
     float getArea(){
@@ -207,20 +195,39 @@ public:
     }
 
     Bounds3 bounding_box;
-    std::unique_ptr<Vector3f[]> vertices;
-    uint32_t numTriangles;
-    std::unique_ptr<uint32_t[]> vertexIndex;
-    std::unique_ptr<Vector2f[]> stCoordinates;
-
-    std::vector<Triangle> triangles;
+    TriangleMesh triangles;
 
     BVHAccel* bvh;
     float area;
 
     Material* m;
+
+private:
+    void init(Material *mt, Buffer<LinearBVHNode> nodes, Buffer<float> areaCdf)
+    {
+        m = mt;
+        triangles.owner = this;
+        triangles.m = mt;
+        if (TriangleMesh::defaultSoA && !triangles.hasSoA())
+            triangles.buildSoA();
+        else if (!TriangleMesh::defaultSoA && triangles.hasSoA())
+            triangles.clearSoA();
+
+        bvh = nodes.empty() ? new BVHAccel(&triangles)
+                            : new BVHAccel(&triangles, std::move(nodes), std::move(areaCdf));
+        // 根节点包围盒就是所有顶点的包围盒；面积与 BVH 在叶节点顺序下累加的总面积相同，
+        // 这样映射的快照不用再读一遍顶点
+        bounding_box = bvh->WorldBound();
+        area = bvh->totalArea;
+    }
 };
 
-inline bool Triangle::intersect(const Ray& ray) { return true; }
+// 只判断 [0, ray.t_max] 内是否有交点，用于阴影测试
+inline bool Triangle::intersect(const Ray& ray)
+{
+    double t;
+    return rayHit(ray, t);
+}
 inline bool Triangle::intersect(const Ray& ray, float& tnear,
                                 uint32_t& index) const
 {
@@ -229,33 +236,38 @@ inline bool Triangle::intersect(const Ray& ray, float& tnear,
 
 inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
 
-inline Intersection Triangle::getIntersection(Ray ray)
+inline bool Triangle::rayHit(const Ray& ray, double& t_tmp) const
 {
-    Intersection inter;
-
     if (dotProduct(ray.direction, normal) > 0)
-        return inter;
-    double u, v, t_tmp = 0;
+        return false;
+    double u, v;
     Vector3f pvec = crossProduct(ray.direction, e2);
     double det = dotProduct(e1, pvec);
     if (fabs(det) < EPSILON)
-        return inter;
+        return false;
 
     double det_inv = 1. / det;
     Vector3f tvec = ray.origin - v0;
     u = dotProduct(tvec, pvec) * det_inv;
     if (u < 0 || u > 1)
-        return inter;
+        return false;
     Vector3f qvec = crossProduct(tvec, e1);
     v = dotProduct(ray.direction, qvec) * det_inv;
     if (v < 0 || u + v > 1)
-        return inter;
+        return false;
     t_tmp = dotProduct(e2, qvec) * det_inv;
 
     // TODO find ray triangle intersection
-    if(t_tmp < 0){
+    return t_tmp >= 0 && t_tmp <= ray.t_max;
+}
+
+inline Intersection Triangle::getIntersection(Ray ray)
+{
+    Intersection inter;
+
+    double t_tmp;
+    if (!rayHit(ray, t_tmp))
         return inter;
-    }
 
     inter.distance = t_tmp;
     inter.coords = ray(t_tmp);
@@ -0,0 +1,196 @@
+//
+// Shared vertex/index buffers of a triangle mesh, intersected by index from BVH leaves.
+//
+
+#ifndef RAYTRACING_TRIANGLEMESH_H
+#define RAYTRACING_TRIANGLEMESH_H
+
+#include <cstdint>
+#include <vector>
+#include "global.hpp"
+#include "Bounds3.hpp"
+#include "Buffer.hpp"
+#include "Intersection.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Sampler.hpp"
+#include "Stats.hpp"
+#include "Vector.hpp"
+
+class Object;
+
+// 三角形只是 indices 中的三个顶点下标，不再为每个三角形创建 Object。
+// 可选的 SoA 布局预先存好每个三角形的 v0, e1, e2，求交时顺序读取，不用再经过 indices 间接寻址。
+// 三角形的编号就是 BVH 叶节点引用的下标，构建 BVH 后按叶节点顺序重排。
+struct TriangleMesh
+{
+    // 新建网格是否生成 SoA 求交布局，可由命令行 --no-tri-soa 关闭
+    inline static bool defaultSoA = true;
+
+    Buffer<Vector3f> positions;        // 共享顶点
+    Buffer<uint32_t> indices;          // 每个三角形 3 个顶点下标，逆时针
+    Object* owner = nullptr;           // 交点记录的物体
+    Material* m = nullptr;
+
+    // SoA 求交布局，为空时从 positions/indices 现算
+    Buffer<float> v0x, v0y, v0z;
+    Buffer<float> e1x, e1y, e1z;
+    Buffer<float> e2x, e2y, e2z;
+
+    size_t size() const { return indices.size() / 3; }
+    bool hasSoA() const { return !v0x.empty(); }
+
+    void getVertices(size_t i, Vector3f &v0, Vector3f &e1, Vector3f &e2) const
+    {
+        if (hasSoA()) {
+            v0 = Vector3f(v0x[i], v0y[i], v0z[i]);
+            e1 = Vector3f(e1x[i], e1y[i], e1z[i]);
+            e2 = Vector3f(e2x[i], e2y[i], e2z[i]);
+            return;
+        }
+        v0 = positions[indices[3 * i]];
+        e1 = positions[indices[3 * i + 1]] - v0;
+        e2 = positions[indices[3 * i + 2]] - v0;
+    }
+
+    Bounds3 getBounds(size_t i) const
+    {
+        return Union(Bounds3(positions[indices[3 * i]], positions[indices[3 * i + 1]]),
+                     positions[indices[3 * i + 2]]);
+    }
+
+    float getArea(size_t i) const
+    {
+        Vector3f v0, e1, e2;
+        getVertices(i, v0, e1, e2);
+        return crossProduct(e1, e2).norm() * 0.5f;
+    }
+
+    // Moller-Trumbore，与 Triangle::rayHit 相同：背面不相交，命中 [0, ray.t_max] 时写入 t。
+    // 实例在物体空间求交，网格尺度和光线方向长度不定，det 不能用绝对阈值，只排除平行的情况
+    bool rayHit(size_t i, const Ray &ray, double &t_tmp) const
+    {
+        STAT_ADD(triangleTests, 1);
+        Vector3f v0, e1, e2;
+        getVertices(i, v0, e1, e2);
+        if (dotProduct(ray.direction, crossProduct(e1, e2)) > 0)
+            return false;
+        double u, v;
+        Vector3f pvec = crossProduct(ray.direction, e2);
+        double det = dotProduct(e1, pvec);
+        if (det == 0)
+            return false;
+
+        double det_inv = 1. / det;
+        Vector3f tvec = ray.origin - v0;
+        u = dotProduct(tvec, pvec) * det_inv;
+        if (u < 0 || u > 1)
+            return false;
+        Vector3f qvec = crossProduct(tvec, e1);
+        v = dotProduct(ray.direction, qvec) * det_inv;
+        if (v < 0 || u + v > 1)
+            return false;
+        t_tmp = dotProduct(e2, qvec) * det_inv;
+        return t_tmp >= 0 && t_tmp <= ray.t_max;
+    }
+
+    // 三角形 [first, first + count) 中最近的交点，找到更近的交点时更新 isect 和 r.t_max
+    void intersect(int first, int count, Ray &r, Intersection &isect) const
+    {
+        int hitIndex = -1;
+        double t;
+        for (int i = first; i < first + count; ++i) {
+            if (rayHit(i, r, t) && t < isect.distance) {
+                isect.distance = t;
+                r.t_max = t;
+                hitIndex = i;
+            }
+        }
+        if (hitIndex < 0)
+            return;
+        Vector3f v0, e1, e2;
+        getVertices(hitIndex, v0, e1, e2);
+        isect.happened = true;
+        isect.coords = r(isect.distance);
+        isect.normal = normalize(crossProduct(e1, e2));
+        isect.m = m;
+        isect.obj = owner;
+        isect.primIndex = hitIndex;
+    }
+
+    bool occluded(int first, int count, const Ray &r) const
+    {
+        double t;
+        for (int i = first; i < first + count; ++i)
+            if (rayHit(i, r, t))
+                return true;
+        return false;
+    }
+
+    void intersectPacket(int first, int count, RayPacket &packet, uint32_t mask, Intersection *hits) const
+    {
+        for (int lane = 0; lane < RayPacket::Size; ++lane) {
+            if (!(mask & (1u << lane)))
+                continue;
+            Ray r = packet.ray(lane);
+            intersect(first, count, r, hits[lane]);
+            packet.tMax[lane] = r.t_max;
+        }
+    }
+
+    // 在三角形 i 上按面积均匀采样
+    void sample(size_t i, Intersection &pos, float &pdf, Sampler &sampler) const
+    {
+        Vector3f v0, e1, e2;
+        getVertices(i, v0, e1, e2);
+        const Vector3f &v1 = positions[indices[3 * i + 1]];
+        const Vector3f &v2 = positions[indices[3 * i + 2]];
+        float x = std::sqrt(sampler.get1D()), y = sampler.get1D();
+        pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
+        pos.normal = normalize(crossProduct(e1, e2));
+        pdf = 1.0f / getArea(i);
+    }
+
+    // 按 order 重排三角形：新的第 i 个三角形是原来的第 order[i] 个
+    void reorder(const std::vector<uint32_t> &order)
+    {
+        std::vector<uint32_t> ordered(indices.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            for (int k = 0; k < 3; ++k)
+                ordered[3 * i + k] = indices[3 * order[i] + k];
+        indices = std::move(ordered);
+        if (hasSoA())
+            buildSoA();
+    }
+
+    void buildSoA()
+    {
+        for (auto *a : {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+            a->resize(size());
+        // 顶点和下标可能是映射快照的只读视图，只通过 const 引用读取
+        const Buffer<Vector3f> &pos = positions;
+        const Buffer<uint32_t> &idx = indices;
+        for (size_t i = 0; i < size(); ++i) {
+            const Vector3f &v0 = pos[idx[3 * i]];
+            Vector3f e1 = pos[idx[3 * i + 1]] - v0;
+            Vector3f e2 = pos[idx[3 * i + 2]] - v0;
+            v0x[i] = v0.x; v0y[i] = v0.y; v0z[i] = v0.z;
+            e1x[i] = e1.x; e1y[i] = e1.y; e1z[i] = e1.z;
+            e2x[i] = e2.x; e2y[i] = e2.y; e2z[i] = e2.z;
+        }
+    }
+
+    void clearSoA()
+    {
+        for (auto *a : {&v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z})
+            a->clear();
+    }
+
+    size_t memoryBytes() const
+    {
+        return positions.size() * sizeof(Vector3f) + indices.size() * sizeof(uint32_t) +
+               9 * v0x.size() * sizeof(float);
+    }
+};
+
+#endif //RAYTRACING_TRIANGLEMESH_H
@@ -0,0 +1,207 @@
+//
+// Wavefront (stream) path tracer working on batches of SoA path states.
+//
+
+#include "Wavefront.hpp"
+#include "Scene.hpp"
+#include "Stats.hpp"
+
+void WavefrontIntegrator::addPath(const Vector3f &origin, const Vector3f &dir, uint32_t pixelIndex,
+                                  uint32_t sampleIndex)
+{
+    pixel.push_back(pixelIndex);
+    ox.push_back(origin.x); oy.push_back(origin.y); oz.push_back(origin.z);
+    dx.push_back(dir.x); dy.push_back(dir.y); dz.push_back(dir.z);
+    tx.push_back(1); ty.push_back(1); tz.push_back(1);
+    Lx.push_back(0); Ly.push_back(0); Lz.push_back(0);
+    nx.push_back(0); ny.push_back(0); nz.push_back(0); pdfPrev.push_back(0);
+    samplers.emplace_back(pixelIndex, sampleIndex);
+    alive.push_back(1);
+    STAT_ADD(paths, 1);
+}
+
+void WavefrontIntegrator::clear()
+{
+    for (auto *v : {&ox, &oy, &oz, &dx, &dy, &dz, &tx, &ty, &tz, &Lx, &Ly, &Lz, &nx, &ny, &nz, &pdfPrev})
+        v->clear();
+    pixel.clear();
+    samplers.clear();
+    alive.clear();
+    active.clear();
+}
+
+void WavefrontIntegrator::run()
+{
+    active.resize(size());
+    for (uint32_t i = 0; i < active.size(); ++i)
+        active[i] = i;
+
+    for (int bounce = 0; !active.empty(); ++bounce) {
+        if (bounce == 0)
+            STAT_ADD(primaryRays, active.size());
+        else
+            STAT_ADD(indirectRays, active.size());
+        extend();
+        shade(bounce);
+        connect();
+        compact();
+    }
+}
+
+void WavefrontIntegrator::extend()
+{
+    hits.resize(active.size());
+    for (size_t s = 0; s < active.size(); ++s) {
+        uint32_t p = active[s];
+        hits[s] = scene.intersect(Ray(Vector3f(ox[p], oy[p], oz[p]), Vector3f(dx[p], dy[p], dz[p])));
+    }
+}
+
+// 着色队列的材质类型在编译期已知，漫反射直接余弦采样，不经过 Material 里按类型的 switch
+template <MaterialType type>
+static Vector3f bsdfSample(Material* m, const Vector3f &wo, const Vector3f &N, Sampler &sampler)
+{
+    if constexpr (type == DIFFUSE)
+        return m->sampleDiffuse(N, sampler);
+    else
+        return m->sampleMicrofacet(wo, N, sampler);
+}
+
+template <MaterialType type>
+static float bsdfPdf(Material* m, const Vector3f &wo, const Vector3f &wi, const Vector3f &N)
+{
+    if constexpr (type == DIFFUSE)
+        return m->pdfDiffuse(wi, N);
+    else
+        return m->pdfMicrofacet(wo, wi, N);
+}
+
+template <MaterialType type>
+static Vector3f bsdfEval(Material* m, const Vector3f &wo, const Vector3f &wi, const Vector3f &N)
+{
+    if constexpr (type == DIFFUSE)
+        return m->evalDiffuse(wi, N);
+    else
+        return m->evalMicrofacet(wo, wi, N);
+}
+
+template <MaterialType type>
+void WavefrontIntegrator::shadeSurfaces(const std::vector<uint32_t> &queue, int bounce)
+{
+    for (uint32_t s : queue) {
+        uint32_t p = active[s];
+        const Intersection &inter = hits[s];
+        Sampler &sampler = samplers[p];
+        Vector3f wo(dx[p], dy[p], dz[p]);
+        Vector3f beta(tx[p], ty[p], tz[p]);
+        const Vector3f &N = inter.normal;
+        const Vector3f &objPos = inter.coords;
+
+        // 采样光源，阴影光线留到 connect 阶段统一测试
+        Intersection lightInter;
+        float pdf_light = 0.0f;
+        scene.sampleLight(objPos, N, lightInter, pdf_light, sampler);
+        const Vector3f &NN = lightInter.normal;
+        Vector3f diff = lightInter.coords - objPos;
+        Vector3f lightDir = diff.normalized();
+        float lightDistance = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+        if (pdf_light > 0 && dotProduct(lightDir, N) > 0 && dotProduct(-lightDir, NN) > 0) {
+            Vector3f f_r = bsdfEval<type>(inter.m, wo, lightDir, N);
+            float pdf_light_w = pdf_light * lightDistance / dotProduct(-lightDir, NN);
+            // 与 castRay 相同：最后一个顶点不做 BSDF 采样，光源采样的权重为 1
+            float w = bounce + 1 >= scene.maxDepth ? 1.0f : powerHeuristic(pdf_light_w, bsdfPdf<type>(inter.m, wo, lightDir, N));
+            Vector3f c = beta * lightInter.emit * f_r * dotProduct(lightDir, N) / pdf_light_w * w;
+            shadowPath.push_back(p);
+            sox.push_back(objPos.x); soy.push_back(objPos.y); soz.push_back(objPos.z);
+            sdx.push_back(lightDir.x); sdy.push_back(lightDir.y); sdz.push_back(lightDir.z);
+            stMax.push_back(std::sqrt(lightDistance) - 1e-2f);
+            scx.push_back(c.x); scy.push_back(c.y); scz.push_back(c.z);
+        }
+
+        // 未达到最大弹射次数时做俄罗斯轮盘赌，存活的路径更新通量并换成下一段光线
+        if (bounce + 1 < scene.maxDepth && sampler.get1D() < scene.RussianRoulette) {
+            Vector3f nextDir = bsdfSample<type>(inter.m, wo, N, sampler).normalized();
+            float pdf = bsdfPdf<type>(inter.m, wo, nextDir, N);
+            if (pdf <= 0) {
+                alive[p] = 0;
+                continue;
+            }
+            Vector3f f_r = bsdfEval<type>(inter.m, wo, nextDir, N);
+            beta = beta * f_r * dotProduct(nextDir, N) / pdf / scene.RussianRoulette;
+            tx[p] = beta.x; ty[p] = beta.y; tz[p] = beta.z;
+            ox[p] = objPos.x; oy[p] = objPos.y; oz[p] = objPos.z;
+            dx[p] = nextDir.x; dy[p] = nextDir.y; dz[p] = nextDir.z;
+            nx[p] = N.x; ny[p] = N.y; nz[p] = N.z;
+            pdfPrev[p] = pdf;
+        }
+        else {
+            if (bounce + 1 < scene.maxDepth)
+                STAT_ADD(rouletteKills, 1);
+            alive[p] = 0;
+        }
+    }
+}
+
+void WavefrontIntegrator::shade(int bounce)
+{
+    // 没打中或打到光源的路径在这里结束，其余按材质类型入队
+    for (auto &q : shadeQueue)
+        q.clear();
+    for (size_t s = 0; s < active.size(); ++s) {
+        uint32_t p = active[s];
+        const Intersection &inter = hits[s];
+        if (!inter.happened) {
+            alive[p] = 0;
+            continue;
+        }
+        STAT_ADD(pathVertices, 1);
+        if (inter.m->hasEmission()) {
+            // 主光线直接看到光源时计入自发光；之后打到光源的是 BSDF 采样，与光源采样按 MIS 加权
+            Vector3f e = inter.m->getEmission();
+            Vector3f dir(dx[p], dy[p], dz[p]);
+            if (bounce == 0) {
+                Lx[p] += e.x; Ly[p] += e.y; Lz[p] += e.z;
+            }
+            else if (dotProduct(-dir, inter.normal) > 0) {
+                Vector3f prevPos(ox[p], oy[p], oz[p]), prevN(nx[p], ny[p], nz[p]);
+                float d2 = inter.distance * inter.distance;
+                float pdf_light_w = scene.pdfLight(prevPos, prevN, inter) * d2 / dotProduct(-dir, inter.normal);
+                Vector3f c = Vector3f(tx[p], ty[p], tz[p]) * e * powerHeuristic(pdfPrev[p], pdf_light_w);
+                Lx[p] += c.x; Ly[p] += c.y; Lz[p] += c.z;
+            }
+            alive[p] = 0;
+        }
+        else {
+            shadeQueue[inter.m->getType()].push_back((uint32_t)s);
+        }
+    }
+
+    shadowPath.clear();
+    for (auto *v : {&sox, &soy, &soz, &sdx, &sdy, &sdz, &stMax, &scx, &scy, &scz})
+        v->clear();
+
+    shadeSurfaces<DIFFUSE>(shadeQueue[DIFFUSE], bounce);
+    shadeSurfaces<Microfacet>(shadeQueue[Microfacet], bounce);
+}
+
+void WavefrontIntegrator::connect()
+{
+    STAT_ADD(shadowRays, shadowPath.size());
+    for (size_t i = 0; i < shadowPath.size(); ++i) {
+        Ray shadow(Vector3f(sox[i], soy[i], soz[i]), Vector3f(sdx[i], sdy[i], sdz[i]));
+        shadow.t_max = stMax[i];
+        if (scene.intersectP(shadow))
+            continue;
+        uint32_t p = shadowPath[i];
+        Lx[p] += scx[i]; Ly[p] += scy[i]; Lz[p] += scz[i];
+    }
+}
+
+void WavefrontIntegrator::compact()
+{
+    size_t n = 0;
+    for (uint32_t p : active)
+        if (alive[p])
+            active[n++] = p;
+    active.resize(n);
+}
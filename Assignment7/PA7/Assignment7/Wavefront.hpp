@@ -0,0 +1,74 @@
+//
+// Wavefront (stream) path tracer working on batches of SoA path states.
+//
+
+#ifndef RAYTRACING_WAVEFRONT_H
+#define RAYTRACING_WAVEFRONT_H
+
+#include <cstdint>
+#include <vector>
+#include "global.hpp"
+#include "Intersection.hpp"
+#include "Material.hpp"
+#include "Sampler.hpp"
+#include "Vector.hpp"
+
+class Scene;
+
+// 与 Scene::castRay 实现同一个积分器，但一次处理一整批路径：每次弹射依次执行
+//   extend  : 所有存活路径求交
+//   shade   : 按材质类型分组着色，采样光源生成阴影光线，俄罗斯轮盘赌后采样下一方向
+//   connect : 批量测试阴影光线，未被遮挡的直接光照累加到路径上
+//   compact : 去掉已结束的路径
+// 每条路径的随机数序列与 castRay 相同，结果只有浮点求和顺序上的差别
+class WavefrontIntegrator
+{
+public:
+    explicit WavefrontIntegrator(const Scene &scene) : scene(scene) {}
+
+    // 加入一条主光线；路径按加入顺序编号
+    void addPath(const Vector3f &origin, const Vector3f &dir, uint32_t pixel, uint32_t sampleIndex);
+    // 追踪所有已加入的路径直到全部结束
+    void run();
+    // 清空本批路径
+    void clear();
+
+    size_t size() const { return pixel.size(); }
+    Vector3f radiance(size_t path) const { return Vector3f(Lx[path], Ly[path], Lz[path]); }
+
+    std::vector<uint32_t> pixel;       // 每条路径所属像素
+
+private:
+    void extend();
+    void shade(int bounce);
+    // 着色一个材质队列，type 在编译期确定，BSDF 直接调用该类型的实现
+    template <MaterialType type>
+    void shadeSurfaces(const std::vector<uint32_t> &queue, int bounce);
+    void connect();
+    void compact();
+
+    const Scene &scene;
+
+    // 路径状态（按路径编号），当前光线、通量和累计辐射度
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+    std::vector<float> tx, ty, tz;
+    std::vector<float> Lx, Ly, Lz;
+    // 上一个顶点的法线和采样当前方向的 BSDF pdf，当前光线打中光源时计算 MIS 权重
+    std::vector<float> nx, ny, nz, pdfPrev;
+    std::vector<Sampler> samplers;
+    std::vector<uint8_t> alive;
+
+    // 存活路径编号，hits[s] 是 active[s] 的交点
+    std::vector<uint32_t> active;
+    std::vector<Intersection> hits;
+    // 按材质类型分组的 active 槽位
+    std::vector<uint32_t> shadeQueue[2];
+
+    // 阴影光线队列：所属路径、线段和未被遮挡时的贡献
+    std::vector<uint32_t> shadowPath;
+    std::vector<float> sox, soy, soz, sdx, sdy, sdz, stMax;
+    std::vector<float> scx, scy, scz;
+};
+
+#endif //RAYTRACING_WAVEFRONT_H
@@ -1,7 +1,6 @@
 #pragma once
 #include <iostream>
 #include <cmath>
-#include <random>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -12,6 +11,15 @@ const float kInfinity = std::numeric_limits<float>::max();
 inline float clamp(const float &lo, const float &hi, const float &v)
 { return std::max(lo, std::min(hi, v)); }
 
+// 两种采样策略合并时的 power heuristic (beta = 2) 权重，f 为当前策略的 pdf，g 为另一种的 pdf
+inline float powerHeuristic(float f, float g)
+{
+    if (f == kInfinity)
+        return 1;
+    f *= f; g *= g;
+    return f + g > 0 ? f / (f + g) : 0;
+}
+
 inline  bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1)
 {
     float discr = b * b - 4 * a * c;
@@ -27,29 +35,3 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     if (x0 > x1) std::swap(x0, x1);
     return true;
 }
-
-inline float get_random_float()
-{
-    static std::random_device dev;
-    static std::mt19937 rng(dev());
-    static std::uniform_real_distribution<float> dist(0.f, 1.f); // distribution in range [1, 6]
-
-    return dist(rng);
-}
-
-inline void UpdateProgress(float progress)
-{
-    int barWidth = 70;
-
-    std::cout << "[";
-    int pos = barWidth * progress;
-    for (int i = 0; i < barWidth; ++i) {
-        if (i < pos) std::cout << "=";
-        else if (i == pos) std::cout << ">";
-        else std::cout << " ";
-    }
-    std::cout << "] " << int(progress * 100.0) << " %\r";
-    std::cout.flush();
-};
-
-
@@ -1,55 +1,131 @@
 #include "Renderer.hpp"
 #include "Scene.hpp"
-#include "Triangle.hpp"
-#include "Sphere.hpp"
+#include "SceneLoader.hpp"
+#include "Instance.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
+#include "ThreadPool.hpp"
 #include <chrono>
+#include <cstring>
 
-// In the main function of the program, we create the scene (create objects and
-// lights) as well as set the options for the render (image width and height,
-// maximum recursion depth, field-of-view, etc.). We then call the render
-// function().
+// In the main function of the program, we load the scene file (objects, lights,
+// image size, camera and spp), let the command line override the render
+// options, and then call the render function().
 int main(int argc, char** argv)
 {
+    Renderer r;
+    SceneLoader loader;
+
+    // --scene PATH 场景文件（缺省 ../scenes/cornellbox.scene），--spp 等选项覆盖文件中的设置
+    // --scene-cache DIR 解析好的网格和 BVH 的缓存目录（缺省 .scenecache），--no-scene-cache 不使用缓存
+    // --threads N 指定渲染线程数，缺省为 CPU 核心数
+    // --progressive 渐进渲染并定期写断点，--resume 从断点文件继续
+    // --adaptive 按方差自适应采样，配合 --min-spp / --max-spp / --noise
+    // --bvh-width 4|8 使用 SIMD 测试包围盒的宽 BVH
+    // --no-packets 主光线逐条求交，不打包
+    // --wavefront 使用波前积分器，--wavefront-batch 指定每批路径数
+    // --no-tri-soa 网格只保留顶点/下标缓冲，不生成 SoA 求交布局
+    // --instances N 在地板上摆放 N 个共享同一份网格和 BVH 的兔子实例
+    // --no-light-bvh 按功率在全部光源中选择，不使用光源 BVH
+    // --max-depth N 路径最多弹射 N 次
+    // --features 写出第一个交点的 albedo / 法线 / 深度缓冲，--denoise 用它们引导去噪
+    // --hdr PATH 浮点帧缓冲的文件名（.pfm 或 .exr，缺省 binary.pfm），--no-hdr 不写
+    std::string scenePath = "../scenes/cornellbox.scene";
+    int spp = 0;
+    int threads = 0;
+    int numInstances = 0;
+    bool lightBVH = true;
+    int maxDepth = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+            scenePath = argv[++i];
+        else if (!strcmp(argv[i], "--scene-cache") && i + 1 < argc)
+            loader.cacheDir = argv[++i];
+        else if (!strcmp(argv[i], "--no-scene-cache"))
+            loader.cacheDir.clear();
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "--spp") || !strcmp(argv[i], "--max-spp")) && i + 1 < argc)
+            spp = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--adaptive"))
+            r.adaptive = true;
+        else if (!strcmp(argv[i], "--min-spp") && i + 1 < argc)
+            r.minSpp = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--noise") && i + 1 < argc)
+            r.targetNoise = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--progressive"))
+            r.progressive = true;
+        else if (!strcmp(argv[i], "--resume"))
+            r.progressive = r.resume = true;
+        else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc)
+            r.checkpointPath = argv[++i];
+        else if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc)
+            r.checkpointInterval = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bvh-width") && i + 1 < argc)
+            BVHAccel::defaultWidth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-packets"))
+            r.primaryPackets = false;
+        else if (!strcmp(argv[i], "--wavefront"))
+            r.wavefront = true;
+        else if (!strcmp(argv[i], "--wavefront-batch") && i + 1 < argc)
+            r.wavefrontBatch = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--no-tri-soa"))
+            TriangleMesh::defaultSoA = false;
+        else if (!strcmp(argv[i], "--instances") && i + 1 < argc)
+            numInstances = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-light-bvh"))
+            lightBVH = false;
+        else if (!strcmp(argv[i], "--max-depth") && i + 1 < argc)
+            maxDepth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--features"))
+            r.writeFeatures = true;
+        else if (!strcmp(argv[i], "--denoise"))
+            r.denoise = true;
+        else if (!strcmp(argv[i], "--denoise-iterations") && i + 1 < argc)
+            r.denoiser.iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--hdr") && i + 1 < argc)
+            r.hdrPath = argv[++i];
+        else if (!strcmp(argv[i], "--no-hdr"))
+            r.hdrPath.clear();
+    }
+    ThreadPool::global(threads);
 
-    // Change the definition here to change resolution
+    // 分辨率、相机和样本数的缺省值由场景文件覆盖
     Scene scene(784, 784);
+    if (!loader.load(scenePath, scene, r))
+        return 1;
+    if (spp > 0)
+        r.spp = spp;
 
-    Material* red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material* green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material* white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    //球体
-    Material* m = new Material(Microfacet, Vector3f(0.0f));
-	m->Ks = Vector3f(0.45, 0.45, 0.45);
-	m->Kd = Vector3f(0.3, 0.3, 0.25);
-	Sphere sphere1(Vector3f(150, 100, 300), 100, m);
-
-    MeshTriangle floor("../models/cornellbox/floor.obj", white);
-    //MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white);
-    //MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("../models/cornellbox/left.obj", red);
-    MeshTriangle right("../models/cornellbox/right.obj", green);
-    MeshTriangle light_("../models/cornellbox/light.obj", light);
-
-    scene.Add(&floor);
-    //scene.Add(&shortbox);
-    //scene.Add(&tallbox);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
-    scene.Add(&sphere1);
+    // 兔子网格只加载和构建一次，每个实例只有一个变换
+    std::vector<std::unique_ptr<Instance>> instances;
+    if (numInstances > 0) {
+        Material* white = loader.material("white");
+        Object* bunny = white ? loader.loadMesh("../models/bunny/bunny.obj", white) : nullptr;
+        if (!bunny) {
+            std::cerr << "--instances needs ../models/bunny/bunny.obj and a material named white\n";
+            return 1;
+        }
+        Bounds3 b = bunny->getBounds();
+        int side = (int)std::ceil(std::sqrt((double)numInstances));
+        float spacing = 540.f / side;
+        float s = 0.8f * spacing / std::max(b.Diagonal().x, b.Diagonal().z);
+        for (int k = 0; k < numInstances; ++k) {
+            Vector3f pos(10 + spacing * (k % side + 0.5f), -b.pMin.y * s, 10 + spacing * (k / side + 0.5f));
+            Transform toWorld = Transform::translate(pos) * Transform::rotate(Vector3f(0, 1, 0), 37.f * k) *
+                                Transform::scale(Vector3f(s)) *
+                                Transform::translate(-0.5f * (b.pMin + b.pMax) * Vector3f(1, 0, 1));
+            instances.emplace_back(new Instance(bunny, toWorld));
+            scene.Add(instances.back().get());
+        }
+        std::cout << "Instances: " << numInstances << " x " << bunny->getAccel()->mesh->size() << " triangles\n";
+    }
 
+    scene.useLightBVH = lightBVH;
+    if (maxDepth > 0)
+        scene.maxDepth = maxDepth;
     scene.buildBVH();
 
-    Renderer r;
-
     auto start = std::chrono::system_clock::now();
     r.Render(scene);
     auto stop = std::chrono::system_clock::now();
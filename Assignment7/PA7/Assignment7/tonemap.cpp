@@ -0,0 +1,57 @@
+//
+// Standalone tone-mapping tool: turns a PFM framebuffer into an 8-bit PPM.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ImageIO.hpp"
+#include "ToneMap.hpp"
+
+// 用法: tonemap input.pfm [output.ppm] [--exposure EV] [--gamma G] [--operator clamp|reinhard|aces]
+// 输出文件缺省为输入文件名换成 .ppm
+int main(int argc, char** argv)
+{
+    ToneMap toneMap;
+    const char* input = nullptr;
+    const char* output = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--exposure") && i + 1 < argc)
+            toneMap.exposure = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--gamma") && i + 1 < argc)
+            toneMap.gamma = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--operator") && i + 1 < argc) {
+            if (!toneMap.setOperator(argv[++i])) {
+                fprintf(stderr, "Unknown operator %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!input)
+            input = argv[i];
+        else if (!output)
+            output = argv[i];
+    }
+    if (!input) {
+        fprintf(stderr, "Usage: %s input.pfm [output.ppm] [--exposure EV] [--gamma G] "
+                        "[--operator clamp|reinhard|aces]\n", argv[0]);
+        return 1;
+    }
+
+    int width, height;
+    std::vector<Vector3f> pixels;
+    if (!readPFM(input, width, height, pixels)) {
+        fprintf(stderr, "Cannot read %s\n", input);
+        return 1;
+    }
+
+    std::string out = output ? output : input;
+    if (!output) {
+        size_t dot = out.find_last_of('.');
+        out = (dot == std::string::npos ? out : out.substr(0, dot)) + ".ppm";
+    }
+    for (Vector3f &p : pixels)
+        p = toneMap(p);
+    writePPM(out, width, height, pixels, toneMap.gamma);
+    printf("%s -> %s (%dx%d)\n", input, out.c_str(), width, height);
+    return 0;
+}